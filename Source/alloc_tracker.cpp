@@ -0,0 +1,231 @@
+#include "alloc_tracker.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#ifdef __linux__
+#include <execinfo.h>
+#include <unistd.h>
+#endif
+
+// Per thread counters. Only the owning thread writes to them, but the main thread reads them
+// when closing a frame, hence the atomics.
+struct ThreadSlot
+{
+    std::atomic<unsigned long long> allocations;
+    std::atomic<unsigned long long> bytes;
+    char name[32];
+};
+
+static ThreadSlot threadSlots[MAX_TRACKED_THREADS];
+static std::atomic<int> usedSlots(0);
+
+// Snapshot taken at beginFrame() and the resulting per frame deltas
+static AllocCounters frameStart[MAX_TRACKED_THREADS];
+static AllocCounters lastFrameCounters[MAX_TRACKED_THREADS];
+
+static thread_local ThreadSlot* currentSlot = nullptr;
+static thread_local bool noAllocationGuard = false;
+
+// Hands out a slot to the calling thread on its first allocation. Must not allocate itself.
+static ThreadSlot* slotForThisThread()
+{
+    if(currentSlot == nullptr)
+    {
+        int index = usedSlots.fetch_add(1);
+        if(index >= MAX_TRACKED_THREADS)
+        {
+            index = MAX_TRACKED_THREADS - 1;
+            usedSlots.store(MAX_TRACKED_THREADS);
+        }
+        else
+        {
+            std::snprintf(threadSlots[index].name, sizeof(threadSlots[index].name), "thread %d", index);
+        }
+        currentSlot = &threadSlots[index];
+    }
+    return currentSlot;
+}
+
+// Reports an allocation made while the guard was up and stops the program. Only uses stdio / raw fds
+// so it can't recurse back into operator new.
+static void failOnFrameAllocation(std::size_t size)
+{
+    noAllocationGuard = false;
+    std::fprintf(stderr, "ERROR::ALLOC_TRACKER:: %zu byte heap allocation inside the steady-state frame loop (%s)\n",
+                 size, slotForThisThread()->name);
+#ifdef __linux__
+    void* frames[32];
+    int depth = backtrace(frames, 32);
+    backtrace_symbols_fd(frames, depth, STDERR_FILENO);
+#endif
+    std::abort();
+}
+
+// ---------------
+// AllocTracker
+// ---------------
+void AllocTracker::record(std::size_t size)
+{
+    if(noAllocationGuard)
+        failOnFrameAllocation(size);
+
+    ThreadSlot* slot = slotForThisThread();
+    slot->allocations.fetch_add(1, std::memory_order_relaxed);
+    slot->bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void AllocTracker::setThreadName(const char* name)
+{
+    ThreadSlot* slot = slotForThisThread();
+    std::strncpy(slot->name, name, sizeof(slot->name) - 1);
+    slot->name[sizeof(slot->name) - 1] = '\0';
+}
+
+void AllocTracker::beginFrame(bool assertNoAllocations)
+{
+    for(int i = 0; i < threadCount(); ++i)
+    {
+        frameStart[i].allocations = threadSlots[i].allocations.load(std::memory_order_relaxed);
+        frameStart[i].bytes = threadSlots[i].bytes.load(std::memory_order_relaxed);
+    }
+    noAllocationGuard = assertNoAllocations;
+}
+
+void AllocTracker::endFrame()
+{
+    noAllocationGuard = false;
+    for(int i = 0; i < threadCount(); ++i)
+    {
+        lastFrameCounters[i].allocations = threadSlots[i].allocations.load(std::memory_order_relaxed) - frameStart[i].allocations;
+        lastFrameCounters[i].bytes = threadSlots[i].bytes.load(std::memory_order_relaxed) - frameStart[i].bytes;
+    }
+}
+
+AllocCounters AllocTracker::lastFrameTotal()
+{
+    AllocCounters result = {};
+    for(int i = 0; i < threadCount(); ++i)
+    {
+        result.allocations += lastFrameCounters[i].allocations;
+        result.bytes += lastFrameCounters[i].bytes;
+    }
+    return result;
+}
+
+AllocCounters AllocTracker::lastFrameThread(int thread)
+{
+    return lastFrameCounters[thread];
+}
+
+const char* AllocTracker::threadName(int thread)
+{
+    return threadSlots[thread].name;
+}
+
+int AllocTracker::threadCount()
+{
+    int count = usedSlots.load();
+    return count < MAX_TRACKED_THREADS ? count : MAX_TRACKED_THREADS;
+}
+
+AllocCounters AllocTracker::total()
+{
+    AllocCounters result = {};
+    for(int i = 0; i < threadCount(); ++i)
+    {
+        result.allocations += threadSlots[i].allocations.load(std::memory_order_relaxed);
+        result.bytes += threadSlots[i].bytes.load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+void AllocTracker::printReport()
+{
+    std::printf("%-16s %12s %12s\n", "thread", "allocations", "bytes");
+    for(int i = 0; i < threadCount(); ++i)
+        std::printf("%-16s %12llu %12llu\n", threadSlots[i].name, lastFrameCounters[i].allocations, lastFrameCounters[i].bytes);
+
+    AllocCounters all = total();
+    std::printf("%-16s %12llu %12llu\n", "since start", all.allocations, all.bytes);
+    std::fflush(stdout);
+}
+
+// ------------------------------------------------
+// Global operator new / delete replacements
+// ------------------------------------------------
+static void* trackedAllocate(std::size_t size)
+{
+    AllocTracker::record(size);
+    if(size == 0)
+        size = 1;
+
+    while(true)
+    {
+        void* pointer = std::malloc(size);
+        if(pointer != nullptr)
+            return pointer;
+
+        std::new_handler handler = std::get_new_handler();
+        if(handler == nullptr)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+
+void* operator new(std::size_t size)
+{
+    return trackedAllocate(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return trackedAllocate(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return trackedAllocate(size);
+    }
+    catch(...)
+    {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return trackedAllocate(size);
+    }
+    catch(...)
+    {
+        return nullptr;
+    }
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
@@ -0,0 +1,45 @@
+#ifndef ALLOC_TRACKER_H
+#define ALLOC_TRACKER_H
+
+#include <cstddef>
+
+// Maximum number of threads that get their own counters (any further threads share the last slot)
+#define MAX_TRACKED_THREADS 16
+
+struct AllocCounters
+{
+    unsigned long long allocations;
+    unsigned long long bytes;
+};
+
+// Counts every allocation that goes through the global operator new (replaced in alloc_tracker.cpp).
+// Counters are kept per thread, and beginFrame()/endFrame() turn them into per-frame numbers.
+// ------------------------------------------------------------------------------------------------
+class AllocTracker
+{
+public:
+    // Called by the global operator new for every allocation
+    static void record(std::size_t size);
+
+    // Names the calling thread in reports (at most 31 characters are kept)
+    static void setThreadName(const char* name);
+
+    // Marks the start of a frame. If assertNoAllocations is set, any allocation on the calling thread
+    // before endFrame() prints the offending size (and a backtrace where available) and aborts.
+    static void beginFrame(bool assertNoAllocations = false);
+    static void endFrame();
+
+    // Counters of the last completed frame
+    static AllocCounters lastFrameTotal();
+    static AllocCounters lastFrameThread(int thread);
+    static const char* threadName(int thread);
+    static int threadCount();
+
+    // Allocations since program start
+    static AllocCounters total();
+
+    // Prints the per thread breakdown of the last frame to the console
+    static void printReport();
+};
+
+#endif
@@ -0,0 +1,474 @@
+#ifndef GL_PROFILER_H
+#define GL_PROFILER_H
+
+#include <glad/glad.h>
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+// Render passes the counters are broken down by
+enum RenderPass
+{
+    PASS_MAIN,
+    PASS_REFLECTION,
+    PASS_REFRACTION,
+    PASS_COUNT
+};
+
+// Everything we count for a single pass of a single frame
+struct GLCounters
+{
+    unsigned int drawCalls;
+    unsigned long long triangles;
+    unsigned int dispatches;            // Compute, e.g. the GPU culling pass
+    unsigned int programSwitches;
+    unsigned int textureBinds;
+    unsigned int vaoBinds;
+    unsigned int uniformUploads;
+    unsigned int skippedUniforms;       // Uploads the Shader setters left out, the value was already there
+    unsigned int bufferUploads;
+    unsigned long long bufferBytes;
+    unsigned int getQueries;
+
+    void add(const GLCounters &other)
+    {
+        drawCalls       += other.drawCalls;
+        triangles       += other.triangles;
+        dispatches      += other.dispatches;
+        programSwitches += other.programSwitches;
+        textureBinds    += other.textureBinds;
+        vaoBinds        += other.vaoBinds;
+        uniformUploads  += other.uniformUploads;
+        skippedUniforms += other.skippedUniforms;
+        bufferUploads   += other.bufferUploads;
+        bufferBytes     += other.bufferBytes;
+        getQueries      += other.getQueries;
+    }
+};
+
+// Optional interception layer around the glad function pointers. Once installed (after gladLoadGLLoader),
+// every hooked GL entry point bumps a counter for the current pass before forwarding to the driver.
+// -------------------------------------------------------------------------------------------------------
+class GLProfiler
+{
+public:
+    // Swaps the glad function pointers for the counting wrappers. Safe to call more than once.
+    static void install()
+    {
+        State &s = state();
+        if(s.installed)
+            return;
+
+        hook(glad_glDrawArrays, s.real.DrawArrays, DrawArrays);
+        hook(glad_glDrawElements, s.real.DrawElements, DrawElements);
+        hook(glad_glDrawArraysInstanced, s.real.DrawArraysInstanced, DrawArraysInstanced);
+        hook(glad_glDrawElementsInstanced, s.real.DrawElementsInstanced, DrawElementsInstanced);
+        hook(glad_glDrawElementsBaseVertex, s.real.DrawElementsBaseVertex, DrawElementsBaseVertex);
+        hook(glad_glMultiDrawElements, s.real.MultiDrawElements, MultiDrawElements);
+        hook(glad_glMultiDrawElementsIndirect, s.real.MultiDrawElementsIndirect, MultiDrawElementsIndirect);
+        hook(glad_glDispatchCompute, s.real.DispatchCompute, DispatchCompute);
+
+        hook(glad_glUseProgram, s.real.UseProgram, UseProgram);
+        hook(glad_glBindProgramPipeline, s.real.BindProgramPipeline, BindProgramPipeline);
+        hook(glad_glActiveShaderProgram, s.real.ActiveShaderProgram, ActiveShaderProgram);
+        hook(glad_glBindTexture, s.real.BindTexture, BindTexture);
+        hook(glad_glBindVertexArray, s.real.BindVertexArray, BindVertexArray);
+
+        hook(glad_glUniform1i, s.real.Uniform1i, Uniform1i);
+        hook(glad_glUniform1ui, s.real.Uniform1ui, Uniform1ui);
+        hook(glad_glUniform1f, s.real.Uniform1f, Uniform1f);
+        hook(glad_glUniform2f, s.real.Uniform2f, Uniform2f);
+        hook(glad_glUniform2fv, s.real.Uniform2fv, Uniform2fv);
+        hook(glad_glUniform3f, s.real.Uniform3f, Uniform3f);
+        hook(glad_glUniform3fv, s.real.Uniform3fv, Uniform3fv);
+        hook(glad_glUniform3uiv, s.real.Uniform3uiv, Uniform3uiv);
+        hook(glad_glUniform4f, s.real.Uniform4f, Uniform4f);
+        hook(glad_glUniform4fv, s.real.Uniform4fv, Uniform4fv);
+        hook(glad_glUniformMatrix2fv, s.real.UniformMatrix2fv, UniformMatrix2fv);
+        hook(glad_glUniformMatrix3fv, s.real.UniformMatrix3fv, UniformMatrix3fv);
+        hook(glad_glUniformMatrix4fv, s.real.UniformMatrix4fv, UniformMatrix4fv);
+
+        hook(glad_glBufferData, s.real.BufferData, BufferData);
+        hook(glad_glBufferSubData, s.real.BufferSubData, BufferSubData);
+
+        hook(glad_glGetUniformLocation, s.real.GetUniformLocation, GetUniformLocation);
+        hook(glad_glGetAttribLocation, s.real.GetAttribLocation, GetAttribLocation);
+        hook(glad_glGetIntegerv, s.real.GetIntegerv, GetIntegerv);
+        hook(glad_glGetFloatv, s.real.GetFloatv, GetFloatv);
+        hook(glad_glGetBooleanv, s.real.GetBooleanv, GetBooleanv);
+        hook(glad_glGetShaderiv, s.real.GetShaderiv, GetShaderiv);
+        hook(glad_glGetProgramiv, s.real.GetProgramiv, GetProgramiv);
+        hook(glad_glGetError, s.real.GetError, GetError);
+
+        s.installed = true;
+    }
+
+    static bool installed()
+    {
+        return state().installed;
+    }
+
+    // Frame / pass bookkeeping
+    // ------------------------
+    static void beginFrame()
+    {
+        State &s = state();
+        std::memset(s.current, 0, sizeof(s.current));
+        s.pass = PASS_MAIN;
+    }
+
+    static void setPass(RenderPass pass)
+    {
+        state().pass = pass;
+    }
+
+    // Called by Shader for every uniform upload it skipped
+    static void countSkippedUniform()
+    {
+        if(state().installed)
+            counters().skippedUniforms++;
+    }
+
+    static void endFrame()
+    {
+        State &s = state();
+        std::memcpy(s.last, s.current, sizeof(s.last));
+    }
+
+    // Counters of the last completed frame
+    static const GLCounters &lastFrame(RenderPass pass)
+    {
+        return state().last[pass];
+    }
+
+    static GLCounters lastFrameTotal()
+    {
+        GLCounters total = {};
+        for(int i = 0; i < PASS_COUNT; ++i)
+            total.add(state().last[i]);
+        return total;
+    }
+
+    // Writes a single line summary of the last frame, short enough for the window title
+    static void formatHud(char *buffer, size_t size)
+    {
+        GLCounters t = lastFrameTotal();
+        std::snprintf(buffer, size, "draws %u | tris %.1fk | dispatches %u | programs %u | tex %u | vao %u | uniforms %u (%u skipped) | buffers %u | gets %u",
+                      t.drawCalls, t.triangles / 1000.0, t.dispatches, t.programSwitches, t.textureBinds, t.vaoBinds,
+                      t.uniformUploads, t.skippedUniforms, t.bufferUploads, t.getQueries);
+    }
+
+    // Prints the per pass breakdown of the last frame to the console
+    static void printReport()
+    {
+        static const char *passNames[PASS_COUNT] = { "main", "reflection", "refraction" };
+
+        std::printf("%-12s %8s %10s %10s %9s %6s %6s %9s %8s %8s %6s\n", "pass", "draws", "tris", "dispatches", "programs",
+                    "tex", "vao", "uniforms", "skipped", "buffers", "gets");
+        for(int i = 0; i <= PASS_COUNT; ++i)
+        {
+            GLCounters c = i < PASS_COUNT ? state().last[i] : lastFrameTotal();
+            std::printf("%-12s %8u %10llu %10u %9u %6u %6u %9u %8u %8u %6u\n", i < PASS_COUNT ? passNames[i] : "total",
+                        c.drawCalls, c.triangles, c.dispatches, c.programSwitches, c.textureBinds, c.vaoBinds,
+                        c.uniformUploads, c.skippedUniforms, c.bufferUploads, c.getQueries);
+        }
+        std::cout << std::flush;
+    }
+
+private:
+    // Original driver entry points
+    struct RealFunctions
+    {
+        PFNGLDRAWARRAYSPROC DrawArrays;
+        PFNGLDRAWELEMENTSPROC DrawElements;
+        PFNGLDRAWARRAYSINSTANCEDPROC DrawArraysInstanced;
+        PFNGLDRAWELEMENTSINSTANCEDPROC DrawElementsInstanced;
+        PFNGLDRAWELEMENTSBASEVERTEXPROC DrawElementsBaseVertex;
+        PFNGLMULTIDRAWELEMENTSPROC MultiDrawElements;
+        PFNGLMULTIDRAWELEMENTSINDIRECTPROC MultiDrawElementsIndirect;
+        PFNGLDISPATCHCOMPUTEPROC DispatchCompute;
+
+        PFNGLUSEPROGRAMPROC UseProgram;
+        PFNGLBINDPROGRAMPIPELINEPROC BindProgramPipeline;
+        PFNGLACTIVESHADERPROGRAMPROC ActiveShaderProgram;
+        PFNGLBINDTEXTUREPROC BindTexture;
+        PFNGLBINDVERTEXARRAYPROC BindVertexArray;
+
+        PFNGLUNIFORM1IPROC Uniform1i;
+        PFNGLUNIFORM1UIPROC Uniform1ui;
+        PFNGLUNIFORM1FPROC Uniform1f;
+        PFNGLUNIFORM2FPROC Uniform2f;
+        PFNGLUNIFORM2FVPROC Uniform2fv;
+        PFNGLUNIFORM3FPROC Uniform3f;
+        PFNGLUNIFORM3FVPROC Uniform3fv;
+        PFNGLUNIFORM3UIVPROC Uniform3uiv;
+        PFNGLUNIFORM4FPROC Uniform4f;
+        PFNGLUNIFORM4FVPROC Uniform4fv;
+        PFNGLUNIFORMMATRIX2FVPROC UniformMatrix2fv;
+        PFNGLUNIFORMMATRIX3FVPROC UniformMatrix3fv;
+        PFNGLUNIFORMMATRIX4FVPROC UniformMatrix4fv;
+
+        PFNGLBUFFERDATAPROC BufferData;
+        PFNGLBUFFERSUBDATAPROC BufferSubData;
+
+        PFNGLGETUNIFORMLOCATIONPROC GetUniformLocation;
+        PFNGLGETATTRIBLOCATIONPROC GetAttribLocation;
+        PFNGLGETINTEGERVPROC GetIntegerv;
+        PFNGLGETFLOATVPROC GetFloatv;
+        PFNGLGETBOOLEANVPROC GetBooleanv;
+        PFNGLGETSHADERIVPROC GetShaderiv;
+        PFNGLGETPROGRAMIVPROC GetProgramiv;
+        PFNGLGETERRORPROC GetError;
+    };
+
+    struct State
+    {
+        bool installed = false;
+        RenderPass pass = PASS_MAIN;
+        GLCounters current[PASS_COUNT] = {};
+        GLCounters last[PASS_COUNT] = {};
+        RealFunctions real = {};
+    };
+
+    static State &state()
+    {
+        static State s;
+        return s;
+    }
+
+    static GLCounters &counters()
+    {
+        State &s = state();
+        return s.current[s.pass];
+    }
+
+    // Remembers the driver entry point and replaces it with our wrapper. Entry points the driver
+    // doesn't expose (e.g. GL 4.3 functions on a 3.3 context) are left untouched.
+    template<typename PFN>
+    static void hook(PFN &gladPointer, PFN &original, PFN wrapper)
+    {
+        if(gladPointer == nullptr)
+            return;
+        original = gladPointer;
+        gladPointer = wrapper;
+    }
+
+    static unsigned long long trianglesFor(GLenum mode, GLsizei count)
+    {
+        if(mode == GL_TRIANGLES)
+            return count / 3;
+        if((mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN) && count > 2)
+            return count - 2;
+        return 0;
+    }
+
+    // Draw calls
+    // ----------
+    static void APIENTRY DrawArrays(GLenum mode, GLint first, GLsizei count)
+    {
+        counters().drawCalls++;
+        counters().triangles += trianglesFor(mode, count);
+        state().real.DrawArrays(mode, first, count);
+    }
+    static void APIENTRY DrawElements(GLenum mode, GLsizei count, GLenum type, const void *indices)
+    {
+        counters().drawCalls++;
+        counters().triangles += trianglesFor(mode, count);
+        state().real.DrawElements(mode, count, type, indices);
+    }
+    static void APIENTRY DrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instances)
+    {
+        counters().drawCalls++;
+        counters().triangles += trianglesFor(mode, count) * instances;
+        state().real.DrawArraysInstanced(mode, first, count, instances);
+    }
+    static void APIENTRY DrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instances)
+    {
+        counters().drawCalls++;
+        counters().triangles += trianglesFor(mode, count) * instances;
+        state().real.DrawElementsInstanced(mode, count, type, indices, instances);
+    }
+    static void APIENTRY DrawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void *indices, GLint baseVertex)
+    {
+        counters().drawCalls++;
+        counters().triangles += trianglesFor(mode, count);
+        state().real.DrawElementsBaseVertex(mode, count, type, indices, baseVertex);
+    }
+    static void APIENTRY MultiDrawElements(GLenum mode, const GLsizei *count, GLenum type, const void *const *indices, GLsizei drawCount)
+    {
+        // One call, but the driver still walks every sub-draw
+        counters().drawCalls++;
+        for(GLsizei i = 0; i < drawCount; ++i)
+            counters().triangles += trianglesFor(mode, count[i]);
+        state().real.MultiDrawElements(mode, count, type, indices, drawCount);
+    }
+    static void APIENTRY MultiDrawElementsIndirect(GLenum mode, GLenum type, const void *indirect, GLsizei drawCount, GLsizei stride)
+    {
+        // The triangle count lives in a GPU buffer, so only the call itself is counted
+        counters().drawCalls++;
+        state().real.MultiDrawElementsIndirect(mode, type, indirect, drawCount, stride);
+    }
+    static void APIENTRY DispatchCompute(GLuint groupsX, GLuint groupsY, GLuint groupsZ)
+    {
+        counters().dispatches++;
+        state().real.DispatchCompute(groupsX, groupsY, groupsZ);
+    }
+
+    // Binds
+    // -----
+    static void APIENTRY UseProgram(GLuint program)
+    {
+        counters().programSwitches++;
+        state().real.UseProgram(program);
+    }
+    static void APIENTRY BindProgramPipeline(GLuint pipeline)
+    {
+        counters().programSwitches++;
+        state().real.BindProgramPipeline(pipeline);
+    }
+    static void APIENTRY ActiveShaderProgram(GLuint pipeline, GLuint program)
+    {
+        // Picks the stage of a pipeline the next glUniform* goes to, a program switch as far as uniforms go
+        counters().programSwitches++;
+        state().real.ActiveShaderProgram(pipeline, program);
+    }
+    static void APIENTRY BindTexture(GLenum target, GLuint texture)
+    {
+        counters().textureBinds++;
+        state().real.BindTexture(target, texture);
+    }
+    static void APIENTRY BindVertexArray(GLuint array)
+    {
+        counters().vaoBinds++;
+        state().real.BindVertexArray(array);
+    }
+
+    // Uniform uploads
+    // ---------------
+    static void APIENTRY Uniform1i(GLint location, GLint v0)
+    {
+        counters().uniformUploads++;
+        state().real.Uniform1i(location, v0);
+    }
+    static void APIENTRY Uniform1ui(GLint location, GLuint v0)
+    {
+        counters().uniformUploads++;
+        state().real.Uniform1ui(location, v0);
+    }
+    static void APIENTRY Uniform1f(GLint location, GLfloat v0)
+    {
+        counters().uniformUploads++;
+        state().real.Uniform1f(location, v0);
+    }
+    static void APIENTRY Uniform2f(GLint location, GLfloat v0, GLfloat v1)
+    {
+        counters().uniformUploads++;
+        state().real.Uniform2f(location, v0, v1);
+    }
+    static void APIENTRY Uniform2fv(GLint location, GLsizei count, const GLfloat *value)
+    {
+        counters().uniformUploads++;
+        state().real.Uniform2fv(location, count, value);
+    }
+    static void APIENTRY Uniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2)
+    {
+        counters().uniformUploads++;
+        state().real.Uniform3f(location, v0, v1, v2);
+    }
+    static void APIENTRY Uniform3fv(GLint location, GLsizei count, const GLfloat *value)
+    {
+        counters().uniformUploads++;
+        state().real.Uniform3fv(location, count, value);
+    }
+    static void APIENTRY Uniform3uiv(GLint location, GLsizei count, const GLuint *value)
+    {
+        counters().uniformUploads++;
+        state().real.Uniform3uiv(location, count, value);
+    }
+    static void APIENTRY Uniform4f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3)
+    {
+        counters().uniformUploads++;
+        state().real.Uniform4f(location, v0, v1, v2, v3);
+    }
+    static void APIENTRY Uniform4fv(GLint location, GLsizei count, const GLfloat *value)
+    {
+        counters().uniformUploads++;
+        state().real.Uniform4fv(location, count, value);
+    }
+    static void APIENTRY UniformMatrix2fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value)
+    {
+        counters().uniformUploads++;
+        state().real.UniformMatrix2fv(location, count, transpose, value);
+    }
+    static void APIENTRY UniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value)
+    {
+        counters().uniformUploads++;
+        state().real.UniformMatrix3fv(location, count, transpose, value);
+    }
+    static void APIENTRY UniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value)
+    {
+        counters().uniformUploads++;
+        state().real.UniformMatrix4fv(location, count, transpose, value);
+    }
+
+    // Buffer uploads
+    // --------------
+    static void APIENTRY BufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage)
+    {
+        counters().bufferUploads++;
+        counters().bufferBytes += size;
+        state().real.BufferData(target, size, data, usage);
+    }
+    static void APIENTRY BufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data)
+    {
+        counters().bufferUploads++;
+        counters().bufferBytes += size;
+        state().real.BufferSubData(target, offset, size, data);
+    }
+
+    // Queries (each one is a potential pipeline stall)
+    // ------------------------------------------------
+    static GLint APIENTRY GetUniformLocation(GLuint program, const GLchar *name)
+    {
+        counters().getQueries++;
+        return state().real.GetUniformLocation(program, name);
+    }
+    static GLint APIENTRY GetAttribLocation(GLuint program, const GLchar *name)
+    {
+        counters().getQueries++;
+        return state().real.GetAttribLocation(program, name);
+    }
+    static void APIENTRY GetIntegerv(GLenum pname, GLint *data)
+    {
+        counters().getQueries++;
+        state().real.GetIntegerv(pname, data);
+    }
+    static void APIENTRY GetFloatv(GLenum pname, GLfloat *data)
+    {
+        counters().getQueries++;
+        state().real.GetFloatv(pname, data);
+    }
+    static void APIENTRY GetBooleanv(GLenum pname, GLboolean *data)
+    {
+        counters().getQueries++;
+        state().real.GetBooleanv(pname, data);
+    }
+    static void APIENTRY GetShaderiv(GLuint shader, GLenum pname, GLint *params)
+    {
+        counters().getQueries++;
+        state().real.GetShaderiv(shader, pname, params);
+    }
+    static void APIENTRY GetProgramiv(GLuint program, GLenum pname, GLint *params)
+    {
+        counters().getQueries++;
+        state().real.GetProgramiv(program, pname, params);
+    }
+    static GLenum APIENTRY GetError()
+    {
+        counters().getQueries++;
+        return state().real.GetError();
+    }
+};
+
+#endif
@@ -0,0 +1,267 @@
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "model.h"
+#include "shader.h"
+#include "object_constants.h"
+#include "resource_registry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+// Atlas layout: IMPOSTOR_FRAMES x IMPOSTOR_FRAMES views of IMPOSTOR_FRAME_SIZE pixels each
+#define IMPOSTOR_FRAMES 8
+#define IMPOSTOR_FRAME_SIZE 128
+
+// Instances one impostor can draw per pass, anything past this falls back to the mesh
+#define IMPOSTOR_MAX_INSTANCES 4096
+
+// Octahedral impostor: a model baked from IMPOSTOR_FRAMES^2 directions spread over the sphere (octahedral
+// mapping, as for the compact normals) into an albedo atlas and a normal + depth atlas. Distant instances are
+// queued with addIfDistant and drawn as camera-facing quads, one instanced draw per impostor, each showing the
+// baked view nearest to its viewing direction.
+// ----------------------------------------------------------------------------------------------------------
+class Impostor
+{
+public:
+    unsigned int albedoAtlas;
+    unsigned int normalDepthAtlas;
+    glm::vec3 center;           // Model space center of the bounding sphere
+    float radius;
+
+    Impostor() : albedoAtlas(0), normalDepthAtlas(0), center(0.0f), radius(0.0f), VAO(0), quadVBO(0), instanceVBO(0)
+    {
+    }
+
+    Impostor(const Impostor&) = delete;
+    Impostor& operator=(const Impostor&) = delete;
+
+    // Renders the model into the atlases. bakeShader is model_loading.vs with impostor_bake.fs.
+    template<typename Layout>
+    void bake(BasicModel<Layout> &model, Shader &bakeShader)
+    {
+        computeBounds(model);
+        ScopedResourceOwner owner(ResourceRegistry::owner("impostors"));
+        createAtlases();
+
+        unsigned int framebuffer, depthRenderbuffer;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoAtlas, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalDepthAtlas, 0);
+        glGenRenderbuffers(1, &depthRenderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, atlasSize(), atlasSize());
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+        GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, drawBuffers);
+
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::IMPOSTOR:: Bake framebuffer is not complete!" << std::endl;
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        GLboolean blending = glIsEnabled(GL_BLEND);
+        glDisable(GL_BLEND);
+
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        bakeShader.use();
+        ObjectConstants::set(glm::mat4(1.0f));
+        bakeShader.setVec4("plane", glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        bakeShader.setVec3("impostorCenter", center);
+        bakeShader.setFloat("impostorRadius", radius);
+
+        // Orthographic views from outside the bounding sphere, one per frame
+        glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, 0.0f, 4.0f * radius);
+        bakeShader.setMat4("projection", projection);
+        for(int y = 0; y < IMPOSTOR_FRAMES; ++y)
+        {
+            for(int x = 0; x < IMPOSTOR_FRAMES; ++x)
+            {
+                glm::vec3 direction = frameDirection(x, y);
+                glm::mat4 view = glm::lookAt(center + direction * (2.0f * radius), center, frameUp(direction));
+                bakeShader.setMat4("view", view);
+                bakeShader.setVec3("impostorDirection", direction);
+
+                glViewport(x * IMPOSTOR_FRAME_SIZE, y * IMPOSTOR_FRAME_SIZE, IMPOSTOR_FRAME_SIZE, IMPOSTOR_FRAME_SIZE);
+                model.Draw(bakeShader);
+            }
+        }
+
+        // Restore state
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        if(blending)
+            glEnable(GL_BLEND);
+        glDeleteRenderbuffers(1, &depthRenderbuffer);
+        glDeleteFramebuffers(1, &framebuffer);
+
+        glBindTexture(GL_TEXTURE_2D, albedoAtlas);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, normalDepthAtlas);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        setupInstancing();
+    }
+
+    // Queues the instance for impostor drawing when it is at least distance away from the camera
+    bool addIfDistant(const glm::mat4 &model, const glm::vec3 &cameraPosition, float distance)
+    {
+        if(albedoAtlas == 0 || instances.size() >= IMPOSTOR_MAX_INSTANCES)
+            return false;
+
+        glm::vec3 worldCenter = glm::vec3(model * glm::vec4(center, 1.0f));
+        glm::vec3 offset = worldCenter - cameraPosition;
+        if(glm::dot(offset, offset) < distance * distance)
+            return false;
+
+        instances.push_back(model);
+        return true;
+    }
+
+    // Draws the queued instances in one instanced draw and empties the queue. The shader's view, projection,
+    // cameraPosition and plane must already be set.
+    void draw(Shader &shader)
+    {
+        if(instances.empty())
+            return;
+
+        shader.setVec3("impostorCenter", center);
+        shader.setFloat("impostorRadius", radius);
+        shader.setFloat("framesPerSide", static_cast<float>(IMPOSTOR_FRAMES));
+        shader.setInt("albedoAtlas", 0);
+        shader.setInt("normalDepthAtlas", 1);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, albedoAtlas);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, normalDepthAtlas);
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(glm::mat4), instances.data());
+
+        glBindVertexArray(VAO);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(instances.size()));
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+
+        instances.clear();
+    }
+
+private:
+    unsigned int VAO, quadVBO, instanceVBO;
+    std::vector<glm::mat4> instances;       // Reserved once, so queueing never allocates
+
+    static int atlasSize()
+    {
+        return IMPOSTOR_FRAMES * IMPOSTOR_FRAME_SIZE;
+    }
+
+    // View direction of a frame: the octahedral decode of the frame's cell (see octDecode in impostor.vs)
+    static glm::vec3 frameDirection(int x, int y)
+    {
+        glm::vec2 e = glm::vec2(static_cast<float>(x), static_cast<float>(y)) / float(IMPOSTOR_FRAMES - 1) * 2.0f - 1.0f;
+        glm::vec3 n(e.x, e.y, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+        float t = std::max(-n.z, 0.0f);
+        n.x += n.x >= 0.0f ? -t : t;
+        n.y += n.y >= 0.0f ? -t : t;
+        return glm::normalize(n);
+    }
+
+    // Up vector of a frame, matched by the billboard basis in impostor.vs
+    static glm::vec3 frameUp(const glm::vec3 &direction)
+    {
+        return std::fabs(direction.y) > 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+
+    template<typename Layout>
+    void computeBounds(const BasicModel<Layout> &model)
+    {
+        MeshBounds bounds;
+        bool first = true;
+        for(unsigned int i = 0; i < model.meshes.size(); ++i)
+            mergeBounds(bounds, model.meshes[i].bounds, first);
+        for(unsigned int i = 0; i < model.skinnedMeshes.size(); ++i)
+            mergeBounds(bounds, model.skinnedMeshes[i].bounds, first);
+
+        center = first ? glm::vec3(0.0f) : bounds.center();
+        radius = first ? 1.0f : std::max(glm::length(bounds.extent()), 1e-4f);
+    }
+
+    static void mergeBounds(MeshBounds &bounds, const MeshBounds &other, bool &first)
+    {
+        if(first)
+        {
+            bounds = other;
+            first = false;
+            return;
+        }
+        bounds.min = glm::min(bounds.min, other.min);
+        bounds.max = glm::max(bounds.max, other.max);
+    }
+
+    void createAtlases()
+    {
+        unsigned int* atlases[2] = { &albedoAtlas, &normalDepthAtlas };
+        for(int i = 0; i < 2; ++i)
+        {
+            glGenTextures(1, atlases[i]);
+            glBindTexture(GL_TEXTURE_2D, *atlases[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlasSize(), atlasSize(), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            ResourceRegistry::record(ResourceRegistry::currentOwner(), RESOURCE_TEXTURE,
+                                     ResourceRegistry::textureBytes(atlasSize(), atlasSize(), 4, true));
+        }
+    }
+
+    // Unit quad corners plus a per instance model matrix (attributes 1-4)
+    void setupInstancing()
+    {
+        float corners[] =
+        {
+            -1.0f, -1.0f,
+             1.0f, -1.0f,
+            -1.0f,  1.0f,
+             1.0f,  1.0f
+        };
+
+        instances.reserve(IMPOSTOR_MAX_INSTANCES);
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &quadVBO);
+        glGenBuffers(1, &instanceVBO);
+        glBindVertexArray(VAO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, IMPOSTOR_MAX_INSTANCES * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+        ResourceRegistry::record(ResourceRegistry::owner("impostors"), RESOURCE_VERTEX_BUFFER,
+                                 IMPOSTOR_MAX_INSTANCES * sizeof(glm::mat4) + sizeof(corners));
+        for(int i = 0; i < 4; ++i)
+        {
+            glEnableVertexAttribArray(1 + i);
+            glVertexAttribPointer(1 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(i * sizeof(glm::vec4)));
+            glVertexAttribDivisor(1 + i, 1);
+        }
+
+        glBindVertexArray(0);
+    }
+};
+
+#endif
@@ -21,13 +21,27 @@
 #include "shader.h"
 #include "camera.h"
 #include "model.h"
+#include "impostor.h"
+#include "static_batch.h"
+#include "occlusion_culler.h"
+#include "software_rasterizer.h"
+#include "opaque_queue.h"
+#include "shader_variants.h"
+#include "shader_reloader.h"
+#include "object_constants.h"
+#include "gl_profiler.h"
+#include "alloc_tracker.h"
+#include "resource_registry.h"
 
 #include <iostream>
+#include <memory>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xOffset, double yOffset);
 void processInput(GLFWwindow* window);
+void updateProfilerHud(GLFWwindow* window, float occlusionTime);
+void finalizeReadyShaders(const std::vector<Shader*> &shaders, ShaderVariants &variants);
 unsigned int loadTexture(char const* path);
 unsigned int loadCubemap(std::vector<std::string> faces);
 
@@ -35,6 +49,69 @@ unsigned int loadCubemap(std::vector<std::string> faces);
 // ---------------
 const unsigned int SCR_WIDTH = 1200;
 const unsigned int SCR_HEIGHT = 900;
+const char* WINDOW_TITLE = "Computer Graphics Project";
+
+// Profiler Settings
+// -----------------
+const bool ENABLE_GL_PROFILER = true;       // Installs the GL call counters after GLAD is loaded
+const float PROFILER_HUD_INTERVAL = 0.5f;   // Seconds between HUD refreshes
+
+// Allocation Settings
+// -------------------
+const bool ASSERT_NO_FRAME_ALLOCATIONS = false;     // Abort on any heap allocation in the steady-state frame loop
+const unsigned int ALLOCATION_WARMUP_FRAMES = 60;   // Frames allowed to allocate before the assertion kicks in
+
+// LOD Settings
+// ------------
+const float LOD_MAX_PIXEL_ERROR = 1.0f;     // Screen-space error, in pixels, a LOD may introduce in the main pass
+const float LOD_REFLECTION_BIAS = 4.0f;     // Error multipliers for the water passes, which are only seen
+const float LOD_REFRACTION_BIAS = 2.0f;     // distorted through the water surface
+
+// Impostor Settings
+// -----------------
+const float IMPOSTOR_DISTANCE = 15.0f;      // Fish further than this from the camera are drawn as impostors
+
+// Static Batch Settings
+// ---------------------
+const float STATIC_BATCH_CHUNK_SIZE = 2.0f;     // World grid cell size the static batches are culled by
+
+// Occlusion Settings
+// ------------------
+const unsigned int OCCLUSION_BUFFER_WIDTH = 256;    // Resolution of the occluder depth the Hi-Z pyramid is built from
+const unsigned int OCCLUSION_BUFFER_HEIGHT = 192;
+const bool SOFTWARE_OCCLUSION = true;               // Rasterize the occluders on the CPU, no read-back and no frame of latency
+const unsigned int SOFTWARE_OCCLUSION_THREADS = 4;  // Including the render thread
+const float SOFTWARE_OCCLUSION_DETAIL = 0.125f;     // Share of the occluders' triangles the CPU rasterizes, at most
+const float SOFTWARE_OCCLUSION_NEAREST = 1.0f;      // Distance down to which occluder simplification stays within a texel
+
+// Depth Pre-Pass Settings
+// -----------------------
+const bool DEPTH_PREPASS = true;            // Static batch depth first (positions only), then shade them with GL_EQUAL.
+                                            // Without it the main pass draws its opaque objects front to back.
+
+// GPU Culling Settings
+// --------------------
+const bool GPU_DRIVEN_CULLING = true;       // Cull the static batches in a compute shader and draw them indirectly (GL 4.3, else the CPU path)
+
+// Meshlet Settings
+// ----------------
+const bool MESHLET_CONE_CULLING = true;     // Skip static batch meshlets facing away from the camera
+
+// Model Shader Variants
+// ---------------------
+// Feature bits of the model shader (see shader_variants.h), and what each one defines, in bit order
+enum ModelShaderFeature
+{
+    MODEL_POINT_LIGHTS = 1 << 0,
+    MODEL_SPOT_LIGHT = 1 << 1,
+    MODEL_CLIP_PLANE = 1 << 2
+};
+const char* const MODEL_SHADER_DEFINES[] = { "NUM_POINT_LIGHTS 1", "HAS_SPOT", "CLIP_PLANE" };
+const char* const SHADER_CACHE_DIRECTORY = "shader_cache";     // Linked program binaries (GL 4.1), "" to always compile
+const bool PARALLEL_SHADER_COMPILE = true;      // Compile on driver threads while the models load (KHR_parallel_shader_compile)
+const bool SEPARABLE_SHADER_STAGES = true;      // Vertex / fragment shaders as pipelines of shared stage programs (GL 4.1)
+const unsigned int OBJECT_CONSTANTS_CAPACITY = 256;     // Objects a frame with their own constant buffer slot
+const bool HOT_RELOAD_SHADERS = true;       // Rebuild shaders when their files under shaders/ are saved (inotify)
 
 // Camera Settings
 // ---------------
@@ -65,18 +142,29 @@ bool spotlightToggleReleased = true;
 bool wireframeToggle = false;
 bool wireframeToggleReleased = true;
 
+bool profilerHudToggle = false;
+bool profilerHudToggleReleased = true;
+
 int main()
 {
+    AllocTracker::setThreadName("main");
+
     // Initialize GLFW and configure GLFW
     // ----------------------------------
+    // (GPU-driven culling asks for 4.3 and falls back to 3.3)
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, GPU_DRIVEN_CULLING ? 4 : 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
     // Create a window object via GLFW
     // -------------------------------
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Computer Graphics Project", NULL, NULL);
+    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, WINDOW_TITLE, NULL, NULL);
+    if(window == NULL && GPU_DRIVEN_CULLING)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, WINDOW_TITLE, NULL, NULL);
+    }
     if(window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
@@ -104,6 +192,15 @@ int main()
         return -1;
     }
 
+    // Compute shaders and indirect draws need GL 4.3, otherwise the static batches cull on the CPU
+    bool gpuCulling = GPU_DRIVEN_CULLING && GLAD_GL_VERSION_4_3;
+    std::cout << "Static batch culling on the " << (gpuCulling ? "GPU" : "CPU") << std::endl;
+
+    // Wrap the GL function pointers with the profiler's counters (toggle the HUD with I)
+    // ----------------------------------------------------------------------------------
+    if(ENABLE_GL_PROFILER)
+        GLProfiler::install();
+
     // Tell stb_image.h to flip loaded textures on the y-axis (before loading model)
     // stbi_set_flip_vertically_on_load(true);
 
@@ -114,20 +211,58 @@ int main()
     // Enable depth testing
     glEnable(GL_DEPTH_TEST);
 
-    // Enable blending
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    // Blending is only enabled around the transparent draws, everything else is opaque and skips the
+    // framebuffer read it costs
     glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ZERO);
 
     // ------------------------------------
     // Build and compile our shader program
     // ------------------------------------
-    Shader ourShader("shaders/vertex/model_loading.vs", "shaders/fragment/model_loading.fs");
+    // Every program is only submitted here. Its link is checked once the driver is done, polled between the model
+    // loads, or else the first time it's used
+    Shader::setCacheDirectory(SHADER_CACHE_DIRECTORY);
+    if(PARALLEL_SHADER_COMPILE)
+        Shader::enableParallelCompile((GLADloadproc)glfwGetProcAddress);
+    if(SEPARABLE_SHADER_STAGES)
+        Shader::enableSeparableStages();
+    Shader::setUniformBlockBinding("Object", ObjectConstants::BINDING);
+    ObjectConstants::init(OBJECT_CONSTANTS_CAPACITY);
+    ShaderVariants modelShaders("shaders/vertex/model_loading.vs", "shaders/fragment/model_loading.fs",
+                                std::vector<std::string>(MODEL_SHADER_DEFINES, MODEL_SHADER_DEFINES + 3));
+    modelShaders.submitAll();      // Every light toggle and clip plane combination, not in the render loop
+    Shader* ourShader = &modelShaders.get(MODEL_POINT_LIGHTS);   // Each pass points it at its variant
     Shader lightCubeShader("shaders/vertex/light_cube.vs", "shaders/fragment/light_cube.fs");
     Shader skyboxShader("shaders/vertex/skybox.vs", "shaders/fragment/skybox.fs");
     Shader waterShader("shaders/vertex/water_shader.vs", "shaders/fragment/water_shader.fs");
     Shader screenShader("shaders/vertex/framebuffers_screen.vs", "shaders/fragment/framebuffers_screen.fs");
     Shader normalShader("shaders/vertex/normal_visualization.vs", "shaders/fragment/normal_visualization.fs", "shaders/geometry/normal_visualization.gs");
+    Shader impostorBakeShader("shaders/vertex/model_loading.vs", "shaders/fragment/impostor_bake.fs");
+    Shader impostorShader("shaders/vertex/impostor.vs", "shaders/fragment/impostor.fs");
+    Shader occluderShader("shaders/vertex/model_loading.vs", "shaders/fragment/depth_only.fs");
+    std::unique_ptr<Shader> batchCullShader(gpuCulling ? new Shader("shaders/compute/static_batch_cull.cs") : nullptr);
+
+    // The programs whose link is polled while the models load (see finalizeReadyShaders)
+    std::vector<Shader*> startupShaders = { &lightCubeShader, &skyboxShader, &waterShader, &screenShader, &normalShader,
+                                            &impostorBakeShader, &impostorShader, &occluderShader };
+    if(batchCullShader)
+        startupShaders.push_back(batchCullShader.get());
+
+    // Edited shaders are swapped in at the start of a frame (ourShader points into the variants)
+    std::unique_ptr<ShaderReloader> shaderReloader(HOT_RELOAD_SHADERS ? new ShaderReloader("shaders") : nullptr);
+    if(shaderReloader)
+    {
+        shaderReloader->watch(modelShaders);
+        shaderReloader->watch(lightCubeShader);
+        shaderReloader->watch(skyboxShader);
+        shaderReloader->watch(waterShader);
+        shaderReloader->watch(screenShader);
+        shaderReloader->watch(normalShader);
+        shaderReloader->watch(impostorBakeShader);
+        shaderReloader->watch(impostorShader);
+        shaderReloader->watch(occluderShader);
+        if(batchCullShader)
+            shaderReloader->watch(*batchCullShader);
+    }
 
     // Set up vertex data (and buffer(s)) and configure vertex attributes
     // ------------------------------------------------------------------
@@ -260,15 +395,93 @@ int main()
     // -----------
     // Load models
     // -----------
-    Model ourModel("res/models/river_color/river_color.obj");
+    Model ourModel("res/models/river_color/river_color.obj", false, RESIDENCY_KEEP_ALL);
     Model fishModel01("res/models/fish_01/fish.obj");
     Model fishModel02("res/models/fish_02/2nd fish.obj");
-    Model reaperModel("res/models/reaper/reaper3.obj");
-    Model seaweedModel("res/models/seaweed/weed13.obj");
-    Model rockModel("res/models/rock/rock_again1.obj");
+    Model reaperModel("res/models/reaper/reaper3.obj", false, RESIDENCY_KEEP_ALL);
+    Model seaweedModel("res/models/seaweed/weed13.obj", false, RESIDENCY_KEEP_ALL);
+    Model rockModel("res/models/rock/rock_again1.obj", false, RESIDENCY_KEEP_ALL);
     Model starfishModel("res/models/starfish/starfish.obj");
     Model eyeFishModel("res/models/eye_fish/eye.obj");
     Model fishRedModel("res/models/fishwhite/fish 2.obj");
+    finalizeReadyShaders(startupShaders, modelShaders);
+
+    // Merge the models that never move into static batches, in world space. The seabed is lit differently
+    // from the props, so it gets a batch of its own.
+    // -----------------------------------------------------------------------------------------------------
+    // The solid ones also go into the software rasterizer, simplified, while their vertices are still around
+    SoftwareRasterizer occluderRasterizer(OCCLUSION_BUFFER_WIDTH, OCCLUSION_BUFFER_HEIGHT, SOFTWARE_OCCLUSION_THREADS);
+    float occluderError = SOFTWARE_OCCLUSION_NEAREST * 2.0f * tan(glm::radians(camera.Zoom) * 0.5f) / OCCLUSION_BUFFER_HEIGHT;
+
+    StaticBatch seabedBatch(STATIC_BATCH_CHUNK_SIZE);
+    glm::mat4 transform = glm::mat4(1.0f);
+    transform = glm::scale(transform, glm::vec3(0.1f, 0.1f, 0.1f));
+    seabedBatch.add(ourModel, transform);
+    occluderRasterizer.addOccluder(ourModel, transform, SOFTWARE_OCCLUSION_DETAIL, occluderError);
+    seabedBatch.build("static_batch/seabed");
+
+    StaticBatch propBatch(STATIC_BATCH_CHUNK_SIZE);
+
+    // Reaper
+    transform = glm::mat4(1.0f);
+    transform = glm::translate(transform, glm::vec3(-1.4f, 0.0f, -1.0f));
+    transform = glm::scale(transform, glm::vec3(0.35f, 0.35f, 0.35f));
+    transform = glm::rotate(transform, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    propBatch.add(reaperModel, transform);
+    occluderRasterizer.addOccluder(reaperModel, transform, SOFTWARE_OCCLUSION_DETAIL, occluderError);
+
+    // Seaweed, each one placed relative to the one before. Its blades are seen from both sides, so no cone culling
+    transform = glm::mat4(1.0f);
+    transform = glm::translate(transform, glm::vec3(-1.5f, -0.1f, 1.0f));
+    transform = glm::scale(transform, glm::vec3(0.35f, 0.35f, 0.35f));
+    propBatch.add(seaweedModel, transform, false);
+
+    transform = glm::translate(transform, glm::vec3(3.2f, 0.0f, -5.0f));
+    transform = glm::scale(transform, glm::vec3(0.7f, 1.2f, 0.7f));
+    transform = glm::rotate(transform, glm::radians(30.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    propBatch.add(seaweedModel, transform, false);
+
+    transform = glm::translate(transform, glm::vec3(-1.0f, 0.5f, -3.0f));
+    transform = glm::scale(transform, glm::vec3(0.8f, 0.7f, 0.8f));
+    transform = glm::rotate(transform, glm::radians(-60.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    propBatch.add(seaweedModel, transform, false);
+
+    // Rock
+    transform = glm::mat4(1.0f);
+    transform = glm::translate(transform, glm::vec3(-1.2f, 0.5f, 2.2f));
+    transform = glm::scale(transform, glm::vec3(0.25f, 0.25f, 0.25f));
+    propBatch.add(rockModel, transform);
+    occluderRasterizer.addOccluder(rockModel, transform, SOFTWARE_OCCLUSION_DETAIL, occluderError);
+
+    propBatch.build("static_batch/props");
+
+    if(gpuCulling)
+    {
+        seabedBatch.enableGpuCulling(*batchCullShader);
+        propBatch.enableGpuCulling(*batchCullShader);
+    }
+
+    // Only the batches draw these now, their own copies of the vertices aren't needed anymore
+    ourModel.releaseCpuData(RESIDENCY_DISCARD);
+    reaperModel.releaseCpuData(RESIDENCY_DISCARD);
+    seaweedModel.releaseCpuData(RESIDENCY_DISCARD);
+    rockModel.releaseCpuData(RESIDENCY_DISCARD);
+    finalizeReadyShaders(startupShaders, modelShaders);
+
+    // Opaque draws of the main pass, see opaque_queue.h
+    OpaqueQueue opaqueQueue;
+
+    // The static batches double as the occluders for Hi-Z culling
+    OcclusionCuller occlusionCuller(OCCLUSION_BUFFER_WIDTH, OCCLUSION_BUFFER_HEIGHT);
+    occlusionCuller.setup();
+
+    // Bake impostors for the models that get drawn far away
+    // -----------------------------------------------------
+    Impostor fishImpostor01, fishImpostor02, eyeFishImpostor, fishRedImpostor;
+    fishImpostor01.bake(fishModel01, impostorBakeShader);
+    fishImpostor02.bake(fishModel02, impostorBakeShader);
+    eyeFishImpostor.bake(eyeFishModel, impostorBakeShader);
+    fishRedImpostor.bake(fishRedModel, impostorBakeShader);
 
     // Configure the light cube's VAO and VBO
     // --------------------------------------
@@ -366,7 +579,11 @@ int main()
         "res/skybox/back.jpg",
     };
     stbi_set_flip_vertically_on_load(false);
-    unsigned int cubemapTexture = loadCubemap(faces);
+    unsigned int cubemapTexture;
+    {
+        ScopedResourceOwner owner(ResourceRegistry::owner("skybox"));
+        cubemapTexture = loadCubemap(faces);
+    }
     stbi_set_flip_vertically_on_load(true);
 
     // --------------------
@@ -411,6 +628,9 @@ int main()
     // Attach the renderbuffer
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, reflectionRbo);
 
+    // Color (RGB8, padded to 4 bytes) plus depth / stencil (4 bytes) per pixel
+    ResourceRegistry::record(ResourceRegistry::owner("reflection framebuffer"), RESOURCE_FRAMEBUFFER, SCR_WIDTH * SCR_HEIGHT * (4 + 4));
+
     // Check and verify framebuffer status
     if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
     {
@@ -447,6 +667,9 @@ int main()
     // Attach the renderbuffer
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, refractionRbo);
 
+    // Color (RGB8, padded to 4 bytes) plus depth / stencil (4 bytes) per pixel
+    ResourceRegistry::record(ResourceRegistry::owner("refraction framebuffer"), RESOURCE_FRAMEBUFFER, SCR_WIDTH * SCR_HEIGHT * (4 + 4));
+
     // Check and verify framebuffer status
     if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
     {
@@ -454,11 +677,23 @@ int main()
     }
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+    // Report what every asset costs (also written to memory_report.json)
+    // ------------------------------------------------------------------
+    ResourceRegistry::printReport();
+    ResourceRegistry::writeJson("memory_report.json");
+
     // -----------
     // Render Loop
     // -----------
+    unsigned int frameCount = 0;
     while(!glfwWindowShouldClose(window))       // Stops when window has been instructed to close
     {
+        // A reload reads files and builds Shaders, so it runs before the frame, which may not allocate
+        if(shaderReloader)
+            shaderReloader->update();
+
+        AllocTracker::beginFrame(ASSERT_NO_FRAME_ALLOCATIONS && frameCount >= ALLOCATION_WARMUP_FRAMES);
+
         // Per-frame time logic
         // --------------------
         float currentFrame = static_cast<float>(glfwGetTime());
@@ -469,10 +704,45 @@ int main()
         // -------------
         processInput(window);
 
+        ObjectConstants::beginFrame();
+        GLProfiler::beginFrame();
+
         // Enable Clipping
         // ---------------
         glEnable(GL_CLIP_DISTANCE0);
 
+        // Occluder Pre-Pass
+        // -----------------
+
+        // Either the simplified occluders on the CPU, ready this frame, or the static batches depth-only into the
+        // occlusion culler's small buffer. The culler reads that back asynchronously, so this frame tests against
+        // the previous frame's occluders.
+        if(SOFTWARE_OCCLUSION)
+        {
+            glm::mat4 view = camera.GetViewMatrix();
+            glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+            occluderRasterizer.render(projection * view);
+            occlusionCuller.setDepth(occluderRasterizer.depth(), projection * view);
+        }
+        else
+        {
+            glm::mat4 view = camera.GetViewMatrix();
+            glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+            MeshletCulling occluderCulling(projection, view, camera.Position, MESHLET_CONE_CULLING);
+
+            occlusionCuller.beginOccluders(projection * view);
+            occluderShader.use();
+            occluderShader.setMat4("view", view);
+            occluderShader.setMat4("projection", projection);
+            occluderShader.setVec4("plane", glm::vec4(0, 0, 0, 0));
+            seabedBatch.DrawDepth(occluderShader, occluderCulling);
+            propBatch.DrawDepth(occluderShader, occluderCulling);
+
+            int framebufferWidth, framebufferHeight;
+            glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+            occlusionCuller.endOccluders(framebufferWidth, framebufferHeight);
+        }
+
         // Wireframe Mode
         // --------------
 
@@ -500,11 +770,13 @@ int main()
         // Oscillate point light
         glm::vec3 pointLightPosition = glm::vec3(sin(glfwGetTime()) * 2.0f, 2.0f, 0.0f);
 
-        // Activate shaders
-        ourShader.use();
-        ourShader.setVec4("plane", glm::vec4(0, 0, 0, 0));
-        ourShader.setVec3("viewPos", camera.Position);
-        ourShader.setFloat("material.shininess", 32.0f);
+        // Activate shaders, the model shader variant without the lights that are off and without clipping
+        unsigned int lightFeatures = (pointLightToggle ? MODEL_POINT_LIGHTS : 0) | (spotlightToggle ? MODEL_SPOT_LIGHT : 0);
+        ourShader = &modelShaders.get(lightFeatures);
+        ourShader->use();
+        ourShader->setVec4("plane", glm::vec4(0, 0, 0, 0));
+        ourShader->setVec3("viewPos", camera.Position);
+        ourShader->setFloat("material.shininess", 32.0f);
 
         /*
             Here we set all the uniforms for the 5/6 types of lights we have. We have to set them manually and index
@@ -516,64 +788,64 @@ int main()
         // Directional Light
         // float sunDir = sin(glfwGetTime()) * 2.0f;
         float sunDir = -0.2f;
-        ourShader.setVec3("dirLight.direction", sunDir, -1.0f, -0.3f);
-        ourShader.setVec3("dirLight.ambient", 0.02f, 0.02f, 0.02f);
+        ourShader->setVec3("dirLight.direction", sunDir, -1.0f, -0.3f);
+        ourShader->setVec3("dirLight.ambient", 0.02f, 0.02f, 0.02f);
         if(directionalLightToggle)
         {
-            ourShader.setVec3("dirLight.diffuse", 0.8f, 0.8f, 0.8f);
-            ourShader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
+            ourShader->setVec3("dirLight.diffuse", 0.8f, 0.8f, 0.8f);
+            ourShader->setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
         }
         else
         {
-            ourShader.setVec3("dirLight.diffuse", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("dirLight.specular", 0.05f, 0.05f, 0.05f);
+            ourShader->setVec3("dirLight.diffuse", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("dirLight.specular", 0.05f, 0.05f, 0.05f);
         }
 
         // Point Light
-        ourShader.setVec3("pointLights[0].position", pointLightPosition);
+        ourShader->setVec3("pointLights[0].position", pointLightPosition);
         if(pointLightToggle)
         {
-            ourShader.setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
-            ourShader.setVec3("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
-            ourShader.setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
+            ourShader->setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
+            ourShader->setVec3("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
+            ourShader->setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
         }
         else
         {
-            ourShader.setVec3("pointLights[0].ambient", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("pointLights[0].diffuse", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("pointLights[0].specular", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("pointLights[0].ambient", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("pointLights[0].diffuse", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("pointLights[0].specular", 0.0f, 0.0f, 0.0f);
         }
 
-        ourShader.setFloat("pointLights[0].constant", 1.0f);
-        ourShader.setFloat("pointLights[0].linear", 0.09f);
-        ourShader.setFloat("pointLights[0].quadratic", 0.032f);
+        ourShader->setFloat("pointLights[0].constant", 1.0f);
+        ourShader->setFloat("pointLights[0].linear", 0.09f);
+        ourShader->setFloat("pointLights[0].quadratic", 0.032f);
 
         // Spotlights
         if(spotlightToggle)
         {
-            ourShader.setVec3("spotLight.position", camera.Position);
-            ourShader.setVec3("spotLight.direction", camera.Front);
-            ourShader.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("spotLight.diffuse", 1.5f, 1.5f, 1.5f);
-            ourShader.setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
-            ourShader.setFloat("spotLight.constant", 1.0f);
-            ourShader.setFloat("spotLight.linear", 0.09f);
-            ourShader.setFloat("spotLight.quadratic", 0.032f);
-            ourShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-            ourShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
+            ourShader->setVec3("spotLight.position", camera.Position);
+            ourShader->setVec3("spotLight.direction", camera.Front);
+            ourShader->setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("spotLight.diffuse", 1.5f, 1.5f, 1.5f);
+            ourShader->setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
+            ourShader->setFloat("spotLight.constant", 1.0f);
+            ourShader->setFloat("spotLight.linear", 0.09f);
+            ourShader->setFloat("spotLight.quadratic", 0.032f);
+            ourShader->setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
+            ourShader->setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
         }
         else
         {
-            ourShader.setVec3("spotLight.position", camera.Position);
-            ourShader.setVec3("spotLight.direction", camera.Front);
-            ourShader.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("spotLight.diffuse", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("spotLight.specular", 0.0f, 0.0f, 0.0f);
-            ourShader.setFloat("spotLight.constant", 1.0f);
-            ourShader.setFloat("spotLight.linear", 0.09f);
-            ourShader.setFloat("spotLight.quadratic", 0.032f);
-            ourShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-            ourShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
+            ourShader->setVec3("spotLight.position", camera.Position);
+            ourShader->setVec3("spotLight.direction", camera.Front);
+            ourShader->setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("spotLight.diffuse", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("spotLight.specular", 0.0f, 0.0f, 0.0f);
+            ourShader->setFloat("spotLight.constant", 1.0f);
+            ourShader->setFloat("spotLight.linear", 0.09f);
+            ourShader->setFloat("spotLight.quadratic", 0.032f);
+            ourShader->setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
+            ourShader->setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
         }
         
         // Transformations
@@ -584,17 +856,36 @@ int main()
         // Reverse camera
         glm::mat4 view = camera.GetViewMatrix();
         glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        ourShader.setMat4("view", view);
-        ourShader.setMat4("projection", projection);
+        LodSelection lodSelection(camera.Position, projection, SCR_HEIGHT, LOD_MAX_PIXEL_ERROR);
+        MeshletCulling meshletCulling(projection, view, camera.Position, MESHLET_CONE_CULLING);
+        glm::mat4 model;
 
-        // World transformation
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
-        model = glm::rotate(model, glm::radians(0.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        ourShader.setMat4("model", model);
+        // Depth pre-pass: the seabed, reaper, seaweed and rock only cost their lighting where they end up visible
+        if(DEPTH_PREPASS)
+        {
+            occluderShader.use();
+            occluderShader.setMat4("view", view);
+            occluderShader.setMat4("projection", projection);
+            occluderShader.setVec4("plane", glm::vec4(0, 0, 0, 0));
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            seabedBatch.DrawDepth(occluderShader, meshletCulling, &occlusionCuller);
+            propBatch.DrawDepth(occluderShader, meshletCulling, &occlusionCuller);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            ourShader->use();
+        }
+
+        ourShader->setMat4("view", view);
+        ourShader->setMat4("projection", projection);
 
-        ourModel.Draw(ourShader);
+        // Seabed, already in world space
+        if(DEPTH_PREPASS)
+        {
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+        seabedBatch.Draw(*ourShader, meshletCulling, &occlusionCuller);
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
 
         // Then draw model with normal visualizing geometry shader
         if(grassGeometryToggle)
@@ -602,28 +893,28 @@ int main()
             normalShader.use();
             normalShader.setMat4("projection", projection);
             normalShader.setMat4("view", view);
-            normalShader.setMat4("model", model);
 
-            ourModel.Draw(normalShader);
+            seabedBatch.Draw(normalShader, meshletCulling, &occlusionCuller);
         }
         
         // ---------
         // 3D Models
         // ---------
 
-        ourShader.use();
+        ourShader->use();
+        opaqueQueue.clear();
 
         // Fish 01
         // -------
 
         // Reducing light intensities
-        ourShader.setVec3("dirLight.diffuse", 0.2f, 0.2f, 0.2f);
-        ourShader.setVec3("dirLight.ambient", 0.15f, 0.15f, 0.15f);
+        ourShader->setVec3("dirLight.diffuse", 0.2f, 0.2f, 0.2f);
+        ourShader->setVec3("dirLight.ambient", 0.15f, 0.15f, 0.15f);
 
         if(spotlightToggle)
-            ourShader.setVec3("spotLight.diffuse", 0.5f, 0.5f, 0.5f);
+            ourShader->setVec3("spotLight.diffuse", 0.5f, 0.5f, 0.5f);
         else
-            ourShader.setVec3("spotLight.diffuse", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("spotLight.diffuse", 0.0f, 0.0f, 0.0f);
 
         // World transformation
         model = glm::mat4(1.0f);
@@ -631,9 +922,7 @@ int main()
         model = glm::scale(model, glm::vec3(0.07f, 0.07f, 0.07f));
         // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
         model = glm::rotate(model, (float)glm::radians(-57.0f * glfwGetTime()), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-
-        fishModel01.Draw(ourShader);
+        opaqueQueue.add(fishModel01, model, &fishImpostor01, camera.Position);
 
         // Fish 02
         // -------
@@ -644,60 +933,11 @@ int main()
         model = glm::scale(model, glm::vec3(0.15f, 0.15f, 0.15f));
         // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
         model = glm::rotate(model, (float)glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-
-        fishModel02.Draw(ourShader);
-
-        // Reaper
-        // ------
-
-        // World transformation
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-1.4f, 0.0f, -1.0f));
-        model = glm::scale(model, glm::vec3(0.35f, 0.35f, 0.35f));
-        // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::rotate(model, (float)glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-
-        reaperModel.Draw(ourShader);
-
-        // Seaweed
-        // -------
-
-        // World transformation
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-1.5f, -0.1f, 1.0f));
-        model = glm::scale(model, glm::vec3(0.35f, 0.35f, 0.35f));
-        // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::rotate(model, (float)glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-
-        seaweedModel.Draw(ourShader);
-
-        model = glm::translate(model, glm::vec3(3.2f, 0.0f, -5.0f));
-        model = glm::scale(model, glm::vec3(0.7f, 1.2f, 0.7f));
-        model = glm::rotate(model, (float)glm::radians(30.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        seaweedModel.Draw(ourShader);
-
-        model = glm::translate(model, glm::vec3(-1.0f, 0.5f, -3.0f));
-        model = glm::scale(model, glm::vec3(0.8f, 0.7f, 0.8f));
-        model = glm::rotate(model, (float)glm::radians(-60.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        seaweedModel.Draw(ourShader);
-
-        // Rock
-        // ----
-        
-        // World transformation
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-1.2f, 0.5f, 2.2f));
-        model = glm::scale(model, glm::vec3(0.25f, 0.25f, 0.25f));
-        // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::rotate(model, (float)glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
+        opaqueQueue.add(fishModel02, model, &fishImpostor02, camera.Position);
 
-        rockModel.Draw(ourShader);
+        // Reaper, seaweed and rock, already in world space
+        // ------------------------------------------------
+        opaqueQueue.add(propBatch, camera.Position);
 
         // Starfish
         // --------
@@ -708,9 +948,7 @@ int main()
         model = glm::scale(model, glm::vec3(0.25f, 0.25f, 0.25f));
         // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
         model = glm::rotate(model, (float)glm::radians(90.0f * glfwGetTime()), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-
-        starfishModel.Draw(ourShader);
+        opaqueQueue.add(starfishModel, model, nullptr, camera.Position);
 
         // Eye Fish
         // --------
@@ -721,9 +959,7 @@ int main()
         model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
         // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
         model = glm::rotate(model, (float)glm::radians(57.0f * glfwGetTime()), glm::vec3(0.0f, 0.0f, 1.0f));
-        ourShader.setMat4("model", model);
-
-        eyeFishModel.Draw(ourShader);
+        opaqueQueue.add(eyeFishModel, model, &eyeFishImpostor, camera.Position);
 
         // Red Fish
         // --------
@@ -734,9 +970,26 @@ int main()
         model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
         // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
         model = glm::rotate(model, (float)glm::radians(180.0f + 10.0f * sin(glfwGetTime() * 5.0f)), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-
-        fishRedModel.Draw(ourShader);
+        opaqueQueue.add(fishRedModel, model, &fishRedImpostor, camera.Position);
+
+        // Nearest first, or in this order on top of the depth pre-pass
+        opaqueQueue.draw(*ourShader, lodSelection, meshletCulling, occlusionCuller, IMPOSTOR_DISTANCE, DEPTH_PREPASS);
+
+        // Distant fish
+        // ------------
+        impostorShader.use();
+        impostorShader.setMat4("view", view);
+        impostorShader.setMat4("projection", projection);
+        impostorShader.setVec3("cameraPosition", camera.Position);
+        impostorShader.setVec4("plane", glm::vec4(0, 0, 0, 0));
+        impostorShader.setVec3("lightDirection", sunDir, -1.0f, -0.3f);
+        impostorShader.setVec3("lightAmbient", 0.15f, 0.15f, 0.15f);
+        impostorShader.setVec3("lightDiffuse", 0.2f, 0.2f, 0.2f);
+
+        fishImpostor01.draw(impostorShader);
+        fishImpostor02.draw(impostorShader);
+        eyeFishImpostor.draw(impostorShader);
+        fishRedImpostor.draw(impostorShader);
 
         // Rendering the lamp object
         // -------------------------
@@ -753,9 +1006,32 @@ int main()
         lightCubeShader.setMat4("model", model);
         glDrawArrays(GL_TRIANGLES, 0, 36);
 
-        // -----
+        // Draw skybox
+        // -----------
+        glDepthFunc(GL_LEQUAL);     // Change depth function so depth test passes when values are equal to depth buffer's content
+        skyboxShader.use();
+        view = glm::mat4(glm::mat3(camera.GetViewMatrix()));    // Removes translation from view matrix
+        skyboxShader.setMat4("view", view);
+        skyboxShader.setMat4("projection", projection);
+
+        // Skybox cube
+        glBindVertexArray(skyboxVAO);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+        glBindVertexArray(0);
+        glDepthFunc(GL_LESS);       // Set depth function back to default
+
+        // ------------------------------------------------------------------------------------------------
+        // Transparent : after everything opaque and the skybox, farthest first, blended, no depth writes
+        // ------------------------------------------------------------------------------------------------
+        glEnable(GL_BLEND);
+        glDepthMask(GL_FALSE);
+
         // Water
         // -----
+
+        // The only translucent surface (alpha 0.2 in water_shader.fs), so there is nothing to sort it against
         waterShader.use();
         glBindVertexArray(reflectionVAO);
 
@@ -765,28 +1041,16 @@ int main()
         model = glm::rotate(model, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
 
         waterShader.setMat4("model", model);
-        waterShader.setMat4("view", view);
+        waterShader.setMat4("view", camera.GetViewMatrix());       // The skybox took the translation out of view
         waterShader.setMat4("projection", projection);
         // waterShader.setInt("refractionTexture", refractionTextureColorbuffer);
         glBindTexture(GL_TEXTURE_2D, reflectionTextureColorbuffer);
 
         glDrawArrays(GL_TRIANGLES, 0, 6);
-
-        // Draw skybox
-        // -----------
-        glDepthFunc(GL_LEQUAL);     // Change depth function so depth test passes when values are equal to depth buffer's content
-        skyboxShader.use();
-        view = glm::mat4(glm::mat3(camera.GetViewMatrix()));    // Removes translation from view matrix
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
-
-        // Skybox cube
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
         glBindVertexArray(0);
-        glDepthFunc(GL_LESS);       // Set depth function back to default
+
+        glDepthMask(GL_TRUE);
+        glDisable(GL_BLEND);
 
         // ---------------------------------------------
         // Second Render Pass : Water Reflection Texture
@@ -794,6 +1058,7 @@ int main()
 
         // Bind to framebuffer and draw scene as we normally would to color texture
         // ------------------------------------------------------------------------
+        GLProfiler::setPass(PASS_REFLECTION);
         glBindFramebuffer(GL_FRAMEBUFFER, reflectionFramebuffer);
         glEnable(GL_DEPTH_TEST);        // Enable depth testing (It's disabled for rendering screen-space quad)
 
@@ -803,70 +1068,71 @@ int main()
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);     // Also clear the depth buffer now
 
         // Activate shaders
-        ourShader.use();
-        ourShader.setVec4("plane", glm::vec4(0, 1, 0, -1));
-        ourShader.setVec3("viewPos", camera.Position);
-        ourShader.setFloat("material.shininess", 32.0f);
+        ourShader = &modelShaders.get(lightFeatures | MODEL_CLIP_PLANE);
+        ourShader->use();
+        ourShader->setVec4("plane", glm::vec4(0, 1, 0, -1));
+        ourShader->setVec3("viewPos", camera.Position);
+        ourShader->setFloat("material.shininess", 32.0f);
 
         // Directional Light
-        ourShader.setVec3("dirLight.direction", sunDir, -1.0f, -0.3f);
-        ourShader.setVec3("dirLight.ambient", 0.02f, 0.02f, 0.02f);
+        ourShader->setVec3("dirLight.direction", sunDir, -1.0f, -0.3f);
+        ourShader->setVec3("dirLight.ambient", 0.02f, 0.02f, 0.02f);
         if(directionalLightToggle)
         {
-            ourShader.setVec3("dirLight.diffuse", 0.8f, 0.8f, 0.8f);
-            ourShader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
+            ourShader->setVec3("dirLight.diffuse", 0.8f, 0.8f, 0.8f);
+            ourShader->setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
         }
         else
         {
-            ourShader.setVec3("dirLight.diffuse", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("dirLight.specular", 0.05f, 0.05f, 0.05f);
+            ourShader->setVec3("dirLight.diffuse", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("dirLight.specular", 0.05f, 0.05f, 0.05f);
         }
 
         // Point Light
-        ourShader.setVec3("pointLights[0].position", pointLightPosition);
+        ourShader->setVec3("pointLights[0].position", pointLightPosition);
         if(pointLightToggle)
         {
-            ourShader.setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
-            ourShader.setVec3("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
-            ourShader.setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
+            ourShader->setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
+            ourShader->setVec3("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
+            ourShader->setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
         }
         else
         {
-            ourShader.setVec3("pointLights[0].ambient", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("pointLights[0].diffuse", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("pointLights[0].specular", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("pointLights[0].ambient", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("pointLights[0].diffuse", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("pointLights[0].specular", 0.0f, 0.0f, 0.0f);
         }
 
-        ourShader.setFloat("pointLights[0].constant", 1.0f);
-        ourShader.setFloat("pointLights[0].linear", 0.09f);
-        ourShader.setFloat("pointLights[0].quadratic", 0.032f);
+        ourShader->setFloat("pointLights[0].constant", 1.0f);
+        ourShader->setFloat("pointLights[0].linear", 0.09f);
+        ourShader->setFloat("pointLights[0].quadratic", 0.032f);
 
         // Spotlights
         if(spotlightToggle)
         {
-            ourShader.setVec3("spotLight.position", camera.Position);
-            ourShader.setVec3("spotLight.direction", camera.Front);
-            ourShader.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("spotLight.diffuse", 1.5f, 1.5f, 1.5f);
-            ourShader.setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
-            ourShader.setFloat("spotLight.constant", 1.0f);
-            ourShader.setFloat("spotLight.linear", 0.09f);
-            ourShader.setFloat("spotLight.quadratic", 0.032f);
-            ourShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-            ourShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
+            ourShader->setVec3("spotLight.position", camera.Position);
+            ourShader->setVec3("spotLight.direction", camera.Front);
+            ourShader->setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("spotLight.diffuse", 1.5f, 1.5f, 1.5f);
+            ourShader->setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
+            ourShader->setFloat("spotLight.constant", 1.0f);
+            ourShader->setFloat("spotLight.linear", 0.09f);
+            ourShader->setFloat("spotLight.quadratic", 0.032f);
+            ourShader->setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
+            ourShader->setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
         }
         else
         {
-            ourShader.setVec3("spotLight.position", camera.Position);
-            ourShader.setVec3("spotLight.direction", camera.Front);
-            ourShader.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("spotLight.diffuse", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("spotLight.specular", 0.0f, 0.0f, 0.0f);
-            ourShader.setFloat("spotLight.constant", 1.0f);
-            ourShader.setFloat("spotLight.linear", 0.09f);
-            ourShader.setFloat("spotLight.quadratic", 0.032f);
-            ourShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-            ourShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
+            ourShader->setVec3("spotLight.position", camera.Position);
+            ourShader->setVec3("spotLight.direction", camera.Front);
+            ourShader->setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("spotLight.diffuse", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("spotLight.specular", 0.0f, 0.0f, 0.0f);
+            ourShader->setFloat("spotLight.constant", 1.0f);
+            ourShader->setFloat("spotLight.linear", 0.09f);
+            ourShader->setFloat("spotLight.quadratic", 0.032f);
+            ourShader->setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
+            ourShader->setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
         }
         
         // Transformations
@@ -877,17 +1143,13 @@ int main()
         // Reverse camera
         view = camera.GetViewMatrix();
         projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        ourShader.setMat4("view", view);
-        ourShader.setMat4("projection", projection);
-
-        // World transformation
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
-        model = glm::rotate(model, glm::radians(0.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        ourShader.setMat4("model", model);
+        lodSelection = LodSelection(camera.Position, projection, SCR_HEIGHT, LOD_MAX_PIXEL_ERROR * LOD_REFLECTION_BIAS);
+        meshletCulling = MeshletCulling(projection, view, camera.Position, MESHLET_CONE_CULLING);
+        ourShader->setMat4("view", view);
+        ourShader->setMat4("projection", projection);
 
-        ourModel.Draw(ourShader);
+        // Seabed, already in world space
+        seabedBatch.Draw(*ourShader, meshletCulling);
 
         // Then draw model with normal visualizing geometry shader
         if(grassGeometryToggle)
@@ -895,28 +1157,27 @@ int main()
             normalShader.use();
             normalShader.setMat4("projection", projection);
             normalShader.setMat4("view", view);
-            normalShader.setMat4("model", model);
 
-            ourModel.Draw(normalShader);
+            seabedBatch.Draw(normalShader, meshletCulling);
         }
         
         // ---------
         // 3D Models
         // ---------
 
-        ourShader.use();
+        ourShader->use();
 
         // Fish 01
         // -------
 
         // Reducing light intensities
-        ourShader.setVec3("dirLight.diffuse", 0.2f, 0.2f, 0.2f);
-        ourShader.setVec3("dirLight.ambient", 0.15f, 0.15f, 0.15f);
+        ourShader->setVec3("dirLight.diffuse", 0.2f, 0.2f, 0.2f);
+        ourShader->setVec3("dirLight.ambient", 0.15f, 0.15f, 0.15f);
 
         if(spotlightToggle)
-            ourShader.setVec3("spotLight.diffuse", 0.5f, 0.5f, 0.5f);
+            ourShader->setVec3("spotLight.diffuse", 0.5f, 0.5f, 0.5f);
         else
-            ourShader.setVec3("spotLight.diffuse", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("spotLight.diffuse", 0.0f, 0.0f, 0.0f);
 
         // World transformation
         model = glm::mat4(1.0f);
@@ -924,9 +1185,10 @@ int main()
         model = glm::scale(model, glm::vec3(0.07f, 0.07f, 0.07f));
         // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
         model = glm::rotate(model, (float)glm::radians(-57.0f * glfwGetTime()), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
+        ObjectConstants::set(model);
 
-        fishModel01.Draw(ourShader);
+        if(!fishImpostor01.addIfDistant(model, camera.Position, IMPOSTOR_DISTANCE))
+            fishModel01.Draw(*ourShader, model, lodSelection);
 
         // Fish 02
         // -------
@@ -937,60 +1199,14 @@ int main()
         model = glm::scale(model, glm::vec3(0.15f, 0.15f, 0.15f));
         // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
         model = glm::rotate(model, (float)glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-
-        fishModel02.Draw(ourShader);
-
-        // Reaper
-        // ------
-
-        // World transformation
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-1.4f, 0.0f, -1.0f));
-        model = glm::scale(model, glm::vec3(0.35f, 0.35f, 0.35f));
-        // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::rotate(model, (float)glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-
-        reaperModel.Draw(ourShader);
-
-        // Seaweed
-        // -------
-
-        // World transformation
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-1.5f, -0.1f, 1.0f));
-        model = glm::scale(model, glm::vec3(0.35f, 0.35f, 0.35f));
-        // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::rotate(model, (float)glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
+        ObjectConstants::set(model);
 
-        seaweedModel.Draw(ourShader);
-
-        model = glm::translate(model, glm::vec3(3.2f, 0.0f, -5.0f));
-        model = glm::scale(model, glm::vec3(0.7f, 1.2f, 0.7f));
-        model = glm::rotate(model, (float)glm::radians(30.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        seaweedModel.Draw(ourShader);
-
-        model = glm::translate(model, glm::vec3(-1.0f, 0.5f, -3.0f));
-        model = glm::scale(model, glm::vec3(0.8f, 0.7f, 0.8f));
-        model = glm::rotate(model, (float)glm::radians(-60.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        seaweedModel.Draw(ourShader);
-
-        // Rock
-        // ----
-        
-        // World transformation
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-1.2f, 0.5f, 2.2f));
-        model = glm::scale(model, glm::vec3(0.25f, 0.25f, 0.25f));
-        // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::rotate(model, (float)glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
+        if(!fishImpostor02.addIfDistant(model, camera.Position, IMPOSTOR_DISTANCE))
+            fishModel02.Draw(*ourShader, model, lodSelection);
 
-        rockModel.Draw(ourShader);
+        // Reaper, seaweed and rock, already in world space
+        // ------------------------------------------------
+        propBatch.Draw(*ourShader, meshletCulling);
 
         // Starfish
         // --------
@@ -1001,9 +1217,9 @@ int main()
         model = glm::scale(model, glm::vec3(0.25f, 0.25f, 0.25f));
         // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
         model = glm::rotate(model, (float)glm::radians(90.0f * glfwGetTime()), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
+        ObjectConstants::set(model);
 
-        starfishModel.Draw(ourShader);
+        starfishModel.Draw(*ourShader, model, lodSelection);
 
         // Eye Fish
         // --------
@@ -1014,9 +1230,10 @@ int main()
         model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
         // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
         model = glm::rotate(model, (float)glm::radians(57.0f * glfwGetTime()), glm::vec3(0.0f, 0.0f, 1.0f));
-        ourShader.setMat4("model", model);
+        ObjectConstants::set(model);
 
-        eyeFishModel.Draw(ourShader);
+        if(!eyeFishImpostor.addIfDistant(model, camera.Position, IMPOSTOR_DISTANCE))
+            eyeFishModel.Draw(*ourShader, model, lodSelection);
 
         // Red Fish
         // --------
@@ -1027,9 +1244,26 @@ int main()
         model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
         // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
         model = glm::rotate(model, (float)glm::radians(180.0f + 10.0f * sin(glfwGetTime() * 5.0f)), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-
-        fishRedModel.Draw(ourShader);
+        ObjectConstants::set(model);
+
+        if(!fishRedImpostor.addIfDistant(model, camera.Position, IMPOSTOR_DISTANCE))
+            fishRedModel.Draw(*ourShader, model, lodSelection);
+
+        // Distant fish
+        // ------------
+        impostorShader.use();
+        impostorShader.setMat4("view", view);
+        impostorShader.setMat4("projection", projection);
+        impostorShader.setVec3("cameraPosition", camera.Position);
+        impostorShader.setVec4("plane", glm::vec4(0, 1, 0, -1));
+        impostorShader.setVec3("lightDirection", sunDir, -1.0f, -0.3f);
+        impostorShader.setVec3("lightAmbient", 0.15f, 0.15f, 0.15f);
+        impostorShader.setVec3("lightDiffuse", 0.2f, 0.2f, 0.2f);
+
+        fishImpostor01.draw(impostorShader);
+        fishImpostor02.draw(impostorShader);
+        eyeFishImpostor.draw(impostorShader);
+        fishRedImpostor.draw(impostorShader);
 
         // Rendering the lamp object
         // -------------------------
@@ -1083,6 +1317,7 @@ int main()
 
         // Bind to framebuffer and draw scene as we normally would to color texture
         // ------------------------------------------------------------------------
+        GLProfiler::setPass(PASS_REFRACTION);
         glBindFramebuffer(GL_FRAMEBUFFER, refractionFramebuffer);
         glEnable(GL_DEPTH_TEST);        // Enable depth testing (It's disabled for rendering screen-space quad)
 
@@ -1092,68 +1327,69 @@ int main()
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);     // Also clear the depth buffer now
 
          // Activate shaders
-        ourShader.use();
-        ourShader.setVec4("plane", glm::vec4(0, -1, 0, 1));
+        ourShader = &modelShaders.get(lightFeatures | MODEL_CLIP_PLANE);
+        ourShader->use();
+        ourShader->setVec4("plane", glm::vec4(0, -1, 0, 1));
 
         // Directional Light
-        ourShader.setVec3("dirLight.direction", sunDir, -1.0f, -0.3f);
-        ourShader.setVec3("dirLight.ambient", 0.02f, 0.02f, 0.02f);
+        ourShader->setVec3("dirLight.direction", sunDir, -1.0f, -0.3f);
+        ourShader->setVec3("dirLight.ambient", 0.02f, 0.02f, 0.02f);
         if(directionalLightToggle)
         {
-            ourShader.setVec3("dirLight.diffuse", 0.8f, 0.8f, 0.8f);
-            ourShader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
+            ourShader->setVec3("dirLight.diffuse", 0.8f, 0.8f, 0.8f);
+            ourShader->setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
         }
         else
         {
-            ourShader.setVec3("dirLight.diffuse", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("dirLight.specular", 0.05f, 0.05f, 0.05f);
+            ourShader->setVec3("dirLight.diffuse", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("dirLight.specular", 0.05f, 0.05f, 0.05f);
         }
 
         // Point Light
-        ourShader.setVec3("pointLights[0].position", pointLightPosition);
+        ourShader->setVec3("pointLights[0].position", pointLightPosition);
         if(pointLightToggle)
         {
-            ourShader.setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
-            ourShader.setVec3("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
-            ourShader.setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
+            ourShader->setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
+            ourShader->setVec3("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
+            ourShader->setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
         }
         else
         {
-            ourShader.setVec3("pointLights[0].ambient", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("pointLights[0].diffuse", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("pointLights[0].specular", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("pointLights[0].ambient", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("pointLights[0].diffuse", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("pointLights[0].specular", 0.0f, 0.0f, 0.0f);
         }
 
-        ourShader.setFloat("pointLights[0].constant", 1.0f);
-        ourShader.setFloat("pointLights[0].linear", 0.09f);
-        ourShader.setFloat("pointLights[0].quadratic", 0.032f);
+        ourShader->setFloat("pointLights[0].constant", 1.0f);
+        ourShader->setFloat("pointLights[0].linear", 0.09f);
+        ourShader->setFloat("pointLights[0].quadratic", 0.032f);
 
         // Spotlights
         if(spotlightToggle)
         {
-            ourShader.setVec3("spotLight.position", camera.Position);
-            ourShader.setVec3("spotLight.direction", camera.Front);
-            ourShader.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("spotLight.diffuse", 1.5f, 1.5f, 1.5f);
-            ourShader.setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
-            ourShader.setFloat("spotLight.constant", 1.0f);
-            ourShader.setFloat("spotLight.linear", 0.09f);
-            ourShader.setFloat("spotLight.quadratic", 0.032f);
-            ourShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-            ourShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
+            ourShader->setVec3("spotLight.position", camera.Position);
+            ourShader->setVec3("spotLight.direction", camera.Front);
+            ourShader->setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("spotLight.diffuse", 1.5f, 1.5f, 1.5f);
+            ourShader->setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
+            ourShader->setFloat("spotLight.constant", 1.0f);
+            ourShader->setFloat("spotLight.linear", 0.09f);
+            ourShader->setFloat("spotLight.quadratic", 0.032f);
+            ourShader->setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
+            ourShader->setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
         }
         else
         {
-            ourShader.setVec3("spotLight.position", camera.Position);
-            ourShader.setVec3("spotLight.direction", camera.Front);
-            ourShader.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("spotLight.diffuse", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("spotLight.specular", 0.0f, 0.0f, 0.0f);
-            ourShader.setFloat("spotLight.constant", 1.0f);
-            ourShader.setFloat("spotLight.linear", 0.09f);
-            ourShader.setFloat("spotLight.quadratic", 0.032f);
-            ourShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-            ourShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
+            ourShader->setVec3("spotLight.position", camera.Position);
+            ourShader->setVec3("spotLight.direction", camera.Front);
+            ourShader->setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("spotLight.diffuse", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("spotLight.specular", 0.0f, 0.0f, 0.0f);
+            ourShader->setFloat("spotLight.constant", 1.0f);
+            ourShader->setFloat("spotLight.linear", 0.09f);
+            ourShader->setFloat("spotLight.quadratic", 0.032f);
+            ourShader->setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
+            ourShader->setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
         }
         
         // Transformations
@@ -1164,17 +1400,13 @@ int main()
         // Reverse camera
         view = camera.GetViewMatrix();
         projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        ourShader.setMat4("view", view);
-        ourShader.setMat4("projection", projection);
-
-        // World transformation
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
-        model = glm::rotate(model, glm::radians(0.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        ourShader.setMat4("model", model);
+        lodSelection = LodSelection(camera.Position, projection, SCR_HEIGHT, LOD_MAX_PIXEL_ERROR * LOD_REFRACTION_BIAS);
+        meshletCulling = MeshletCulling(projection, view, camera.Position, MESHLET_CONE_CULLING);
+        ourShader->setMat4("view", view);
+        ourShader->setMat4("projection", projection);
 
-        ourModel.Draw(ourShader);
+        // Seabed, already in world space
+        seabedBatch.Draw(*ourShader, meshletCulling, &occlusionCuller);
 
         // Then draw model with normal visualizing geometry shader
         if(grassGeometryToggle)
@@ -1182,28 +1414,27 @@ int main()
             normalShader.use();
             normalShader.setMat4("projection", projection);
             normalShader.setMat4("view", view);
-            normalShader.setMat4("model", model);
 
-            ourModel.Draw(normalShader);
+            seabedBatch.Draw(normalShader, meshletCulling, &occlusionCuller);
         }
         
         // ---------
         // 3D Models
         // ---------
 
-        ourShader.use();
+        ourShader->use();
 
         // Fish 01
         // -------
 
         // Reducing light intensities
-        ourShader.setVec3("dirLight.diffuse", 0.2f, 0.2f, 0.2f);
-        ourShader.setVec3("dirLight.ambient", 0.15f, 0.15f, 0.15f);
+        ourShader->setVec3("dirLight.diffuse", 0.2f, 0.2f, 0.2f);
+        ourShader->setVec3("dirLight.ambient", 0.15f, 0.15f, 0.15f);
 
         if(spotlightToggle)
-            ourShader.setVec3("spotLight.diffuse", 0.5f, 0.5f, 0.5f);
+            ourShader->setVec3("spotLight.diffuse", 0.5f, 0.5f, 0.5f);
         else
-            ourShader.setVec3("spotLight.diffuse", 0.0f, 0.0f, 0.0f);
+            ourShader->setVec3("spotLight.diffuse", 0.0f, 0.0f, 0.0f);
 
         // World transformation
         model = glm::mat4(1.0f);
@@ -1211,9 +1442,10 @@ int main()
         model = glm::scale(model, glm::vec3(0.07f, 0.07f, 0.07f));
         // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
         model = glm::rotate(model, (float)glm::radians(-57.0f * glfwGetTime()), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
+        ObjectConstants::set(model);
 
-        fishModel01.Draw(ourShader);
+        if(occlusionCuller.visible(fishModel01.bounds, model) && !fishImpostor01.addIfDistant(model, camera.Position, IMPOSTOR_DISTANCE))
+            fishModel01.Draw(*ourShader, model, lodSelection);
 
         // Fish 02
         // -------
@@ -1224,60 +1456,14 @@ int main()
         model = glm::scale(model, glm::vec3(0.15f, 0.15f, 0.15f));
         // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
         model = glm::rotate(model, (float)glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-
-        fishModel02.Draw(ourShader);
-
-        // Reaper
-        // ------
-
-        // World transformation
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-1.4f, 0.0f, -1.0f));
-        model = glm::scale(model, glm::vec3(0.35f, 0.35f, 0.35f));
-        // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::rotate(model, (float)glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-
-        reaperModel.Draw(ourShader);
-
-        // Seaweed
-        // -------
-
-        // World transformation
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-1.5f, -0.1f, 1.0f));
-        model = glm::scale(model, glm::vec3(0.35f, 0.35f, 0.35f));
-        // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::rotate(model, (float)glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-
-        seaweedModel.Draw(ourShader);
+        ObjectConstants::set(model);
 
-        model = glm::translate(model, glm::vec3(3.2f, 0.0f, -5.0f));
-        model = glm::scale(model, glm::vec3(0.7f, 1.2f, 0.7f));
-        model = glm::rotate(model, (float)glm::radians(30.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        seaweedModel.Draw(ourShader);
+        if(occlusionCuller.visible(fishModel02.bounds, model) && !fishImpostor02.addIfDistant(model, camera.Position, IMPOSTOR_DISTANCE))
+            fishModel02.Draw(*ourShader, model, lodSelection);
 
-        model = glm::translate(model, glm::vec3(-1.0f, 0.5f, -3.0f));
-        model = glm::scale(model, glm::vec3(0.8f, 0.7f, 0.8f));
-        model = glm::rotate(model, (float)glm::radians(-60.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        seaweedModel.Draw(ourShader);
-
-        // Rock
-        // ----
-        
-        // World transformation
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-1.2f, 0.5f, 2.2f));
-        model = glm::scale(model, glm::vec3(0.25f, 0.25f, 0.25f));
-        // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::rotate(model, (float)glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-
-        rockModel.Draw(ourShader);
+        // Reaper, seaweed and rock, already in world space
+        // ------------------------------------------------
+        propBatch.Draw(*ourShader, meshletCulling, &occlusionCuller);
 
         // Starfish
         // --------
@@ -1288,9 +1474,10 @@ int main()
         model = glm::scale(model, glm::vec3(0.25f, 0.25f, 0.25f));
         // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
         model = glm::rotate(model, (float)glm::radians(90.0f * glfwGetTime()), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
+        ObjectConstants::set(model);
 
-        starfishModel.Draw(ourShader);
+        if(occlusionCuller.visible(starfishModel.bounds, model))
+            starfishModel.Draw(*ourShader, model, lodSelection);
 
         // Eye Fish
         // --------
@@ -1301,9 +1488,10 @@ int main()
         model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
         // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
         model = glm::rotate(model, (float)glm::radians(57.0f * glfwGetTime()), glm::vec3(0.0f, 0.0f, 1.0f));
-        ourShader.setMat4("model", model);
+        ObjectConstants::set(model);
 
-        eyeFishModel.Draw(ourShader);
+        if(occlusionCuller.visible(eyeFishModel.bounds, model) && !eyeFishImpostor.addIfDistant(model, camera.Position, IMPOSTOR_DISTANCE))
+            eyeFishModel.Draw(*ourShader, model, lodSelection);
 
         // Red Fish
         // --------
@@ -1314,9 +1502,26 @@ int main()
         model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
         // model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
         model = glm::rotate(model, (float)glm::radians(180.0f + 10.0f * sin(glfwGetTime() * 5.0f)), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-
-        fishRedModel.Draw(ourShader);
+        ObjectConstants::set(model);
+
+        if(occlusionCuller.visible(fishRedModel.bounds, model) && !fishRedImpostor.addIfDistant(model, camera.Position, IMPOSTOR_DISTANCE))
+            fishRedModel.Draw(*ourShader, model, lodSelection);
+
+        // Distant fish
+        // ------------
+        impostorShader.use();
+        impostorShader.setMat4("view", view);
+        impostorShader.setMat4("projection", projection);
+        impostorShader.setVec3("cameraPosition", camera.Position);
+        impostorShader.setVec4("plane", glm::vec4(0, -1, 0, 1));
+        impostorShader.setVec3("lightDirection", sunDir, -1.0f, -0.3f);
+        impostorShader.setVec3("lightAmbient", 0.15f, 0.15f, 0.15f);
+        impostorShader.setVec3("lightDiffuse", 0.2f, 0.2f, 0.2f);
+
+        fishImpostor01.draw(impostorShader);
+        fishImpostor02.draw(impostorShader);
+        eyeFishImpostor.draw(impostorShader);
+        fishRedImpostor.draw(impostorShader);
 
         // Rendering the lamp object
         // -------------------------
@@ -1364,10 +1569,18 @@ int main()
 
         glEnable(GL_DEPTH_TEST);
 
+        // Profiler HUD
+        // ------------
+        GLProfiler::endFrame();
+        updateProfilerHud(window, SOFTWARE_OCCLUSION ? occluderRasterizer.renderTime() : 0.0f);
+
         // GLFW : swap buffers and poll IO events (keys pressed/released, mouse moved etc)
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(window);
         glfwPollEvents();
+
+        AllocTracker::endFrame();
+        ++frameCount;
     }
 
     // GLFW : Terminate, clearing all previously allocated GLFW resources
@@ -1460,6 +1673,82 @@ void processInput(GLFWwindow *window)
         wireframeToggle ^= 0x1;
         wireframeToggleReleased = false;
     }
+
+    // Profiler HUD toggle
+    // -------------------
+    if(glfwGetKey(window, GLFW_KEY_I) == GLFW_RELEASE)
+        profilerHudToggleReleased = true;
+    else if(glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS && profilerHudToggleReleased == true)
+    {
+        profilerHudToggle ^= 0x1;
+        profilerHudToggleReleased = false;
+
+        if(!profilerHudToggle)
+            glfwSetWindowTitle(window, WINDOW_TITLE);
+        else
+        {
+            if(GLProfiler::installed())
+                GLProfiler::printReport();
+            AllocTracker::printReport();
+            ResourceRegistry::printReport();
+        }
+    }
+}
+
+// Shows the last frame's allocation and GL counters in the window title, refreshed every PROFILER_HUD_INTERVAL seconds.
+// occlusionTime is the software occlusion's milliseconds, 0 hides it.
+// ------------------------------------------------------------------------------------------------------
+void updateProfilerHud(GLFWwindow* window, float occlusionTime)
+{
+    static float lastUpdate = 0.0f;
+    static unsigned int frames = 0;
+    static char title[512];
+
+    if(!profilerHudToggle)
+    {
+        lastUpdate = lastFrame;
+        frames = 0;
+        return;
+    }
+
+    ++frames;
+    if(lastFrame - lastUpdate < PROFILER_HUD_INTERVAL)
+        return;
+
+    int length = std::snprintf(title, sizeof(title), "%s | %.1f fps | ", WINDOW_TITLE, frames / (lastFrame - lastUpdate));
+    AllocCounters allocations = AllocTracker::lastFrameTotal();
+    length += std::snprintf(title + length, sizeof(title) - length, "allocs %llu (%.1f KB) | mem cpu %.1f MB gpu %.1f MB",
+                            allocations.allocations, allocations.bytes / 1024.0,
+                            ResourceRegistry::totalBytes(MEMORY_CPU) / (1024.0 * 1024.0),
+                            ResourceRegistry::totalBytes(MEMORY_GPU) / (1024.0 * 1024.0));
+    if(occlusionTime > 0.0f)
+        length += std::snprintf(title + length, sizeof(title) - length, " | occlusion %.2f ms", occlusionTime);
+    if(GLProfiler::installed())
+    {
+        length += std::snprintf(title + length, sizeof(title) - length, " | ");
+        GLProfiler::formatHud(title + length, sizeof(title) - length);
+    }
+    glfwSetWindowTitle(window, title);
+
+    lastUpdate = lastFrame;
+    frames = 0;
+}
+
+// Checks the link of every program the driver is done with (KHR_parallel_shader_compile), so the error reports
+// and binary cache writes happen while the models load. Programs still compiling wait for their first use.
+// -------------------------------------------------------------------------------------------------------------
+void finalizeReadyShaders(const std::vector<Shader*> &shaders, ShaderVariants &variants)
+{
+    for(unsigned int i = 0; i < shaders.size(); ++i)
+    {
+        if(shaders[i]->ready())
+            shaders[i]->finalize();
+    }
+    variants.forEachVariant([](Shader &shader)
+    {
+        if(shader.ready())
+            shader.finalize();
+    });
 }
 
 // GLFW : Whenever the mouse moves, this callback function is called
@@ -1511,6 +1800,10 @@ unsigned int loadTexture(char const* path)
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
+        // Drivers pad RGB8 textures to 4 bytes per texel
+        ResourceRegistry::record(ResourceRegistry::currentOwner(), RESOURCE_TEXTURE,
+                                 ResourceRegistry::textureBytes(width, height, nrComponents == 3 ? 4 : nrComponents, true));
+
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -1551,6 +1844,8 @@ unsigned int loadCubemap(std::vector<std::string> faces)
         if(data)
         {
             glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+            ResourceRegistry::record(ResourceRegistry::currentOwner(), RESOURCE_CUBEMAP,
+                                     ResourceRegistry::textureBytes(width, height, 4, false));
             stbi_image_free(data);
         }
         else
@@ -7,113 +7,331 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "shader.h"
+#include "resource_registry.h"
+#include "vertex_format.h"
+#include "vertex_layout.h"
+#include "mesh_lod.h"
+#include "meshlet.h"
 
 #include <string>
 #include <vector>
 
-#define MAX_BONE_INFLUENCE 4
+// Meshes with at most this many vertices get 16-bit indices
+#define MAX_16BIT_INDEXED_VERTICES 65536
 
-struct Vertex
+struct Texture
 {
-    // Position
-    glm::vec3 Position;
-
-    // Normal
-    glm::vec3 Normal;
-
-    // Texture Coordinates
-    glm::vec2 TexCoords;
+    unsigned int id;
+    std::string type;
+    std::string path;
+};
 
-    // Tangent
-    glm::vec3 Tangent;
+// Sampler uniform name of each texture, following the texture_typeN convention (e.g. texture_diffuse1)
+inline void buildSamplerNames(const std::vector<Texture> &textures, std::vector<std::string> &samplerNames)
+{
+    unsigned int diffuseNr = 1;
+    unsigned int specularNr = 1;
+    unsigned int normalNr = 1;
+    unsigned int heightNr = 1;
 
-    // Bitangent
-    glm::vec3 Bitangent;
+    samplerNames.reserve(textures.size());
+    for(unsigned int i = 0; i < textures.size(); ++i)
+    {
+        // Retrieve texture number (The N in diffuse_textureN)
+        std::string number;
+        std::string name = textures[i].type;
+
+        if(name == "texture_diffuse")
+            number = std::to_string(diffuseNr++);
+        else if(name == "texture_specular")
+            number = std::to_string(specularNr++);
+        else if(name == "texture_normal")
+            number = std::to_string(normalNr++);
+        else if(name == "texture_height")
+            number = std::to_string(heightNr++);
+
+        samplerNames.push_back(name + number);
+    }
+}
 
-    // Bone indices which will influence this vertex
-    int m_BoneIDs[MAX_BONE_INFLUENCE];
-    // Weight from each bone
-    float m_Weights[MAX_BONE_INFLUENCE];
+// What a mesh keeps in CPU memory once its data has been uploaded to the GPU
+enum MeshResidency
+{
+    RESIDENCY_DISCARD,          // Drop the CPU copies, only the GPU buffers remain
+    RESIDENCY_POSITIONS_ONLY,   // Keep positions and indices (picking, collision, occluders)
+    RESIDENCY_KEEP_ALL          // Keep the full vertices and indices
 };
 
-struct Texture
+// Source arrays a mesh is built from (typically import scratch memory)
+struct MeshData
 {
-    unsigned int id;
-    std::string type;
-    std::string path;
+    const Vertex* vertices;
+    unsigned int vertexCount;
+    const unsigned int* indices;
+    unsigned int indexCount;        // All LODs together
+    const VertexBoneData* bones;    // One per vertex, nullptr for static meshes
+    const MeshLod* lods;            // Index ranges of each LOD, nullptr when indices hold just the one
+    unsigned int lodCount;
+    const Meshlet* meshlets;        // Clusters of LOD 0, nullptr when it is always drawn whole
+    unsigned int meshletCount;
 };
 
-class Mesh
+// A mesh stored in the given vertex layout (see vertex_layout.h)
+template<typename Layout>
+class BasicMesh
 {
 public:
-    // Mesh data
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
+    // Mesh data (what survives after upload depends on the residency)
+    std::vector<Vertex> vertices;           // RESIDENCY_KEEP_ALL
+    std::vector<glm::vec3> positions;       // RESIDENCY_POSITIONS_ONLY
+    std::vector<unsigned int> indices;      // RESIDENCY_POSITIONS_ONLY and RESIDENCY_KEEP_ALL
     std::vector<Texture> textures;
+    unsigned int indexCount;                // Of LOD 0
+    std::vector<MeshLod> lods;              // Index ranges of the LOD chain, lods[0] is the full mesh
+    std::vector<Meshlet> meshlets;          // Clusters of LOD 0 for DrawMeshlets, empty for small meshes
+    GLenum indexType;                       // GL_UNSIGNED_SHORT when the vertices fit, else GL_UNSIGNED_INT
+    MeshResidency residency;
+    MeshBounds bounds;                      // Model space bounds, also used to quantize snorm16 positions
     unsigned int VAO;
 
-    // Constructor
-    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures)
+    // Constructor, uploads straight from the given arrays (e.g. import scratch memory) and only copies
+    // into the mesh what the residency asks to keep
+    BasicMesh(const MeshData &data, std::vector<Texture> &&textures, MeshResidency residency = RESIDENCY_DISCARD)
+        : textures(std::move(textures)), indexCount(data.lodCount > 0 ? data.lods[0].indexCount : data.indexCount),
+          indexType(data.vertexCount <= MAX_16BIT_INDEXED_VERTICES ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT), residency(residency),
+          ownerId(ResourceRegistry::currentOwner())
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
-
         // Now that we have all the required data, set the vertex buffers and its attribute pointers
-        setupMesh();
+        computeBounds(data);
+        setupLods(data);
+        setupMeshlets(data);
+        setupMesh(data);
+        setupSamplerNames();
+        retainCpuData(data);
     }
 
-    // ---------------
-    // Render the mesh
-    // ---------------
-    void Draw(Shader &shader)
+    BasicMesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, std::vector<Texture> textures,
+              MeshResidency residency = RESIDENCY_DISCARD)
+        : BasicMesh(makeMeshData(vertices, indices), std::move(textures), residency)
     {
-        // Bind appropriate textures
-        // -------------------------
-        unsigned int diffuseNr = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr = 1;
-        unsigned int heightNr = 1;
+    }
 
-        for(unsigned int i = 0; i < textures.size(); ++i)
+    // Meshes own GL objects, so they can be moved but not copied
+    BasicMesh(const BasicMesh&) = delete;
+    BasicMesh& operator=(const BasicMesh&) = delete;
+    BasicMesh(BasicMesh&&) = default;
+    BasicMesh& operator=(BasicMesh&&) = default;
+
+    // Drops CPU-side data down to the given residency (it can only shrink, dropped data doesn't come back)
+    void releaseCpuData(MeshResidency target)
+    {
+        if(target >= residency)
+            return;
+
+        ResourceRegistry::release(ownerId, RESOURCE_MESH_DATA, cpuBytes());
+
+        if(target == RESIDENCY_POSITIONS_ONLY)
         {
-            glActiveTexture(GL_TEXTURE0 + i);      // Activate the proper texture unit before binding
+            positions.reserve(vertices.size());
+            for(unsigned int i = 0; i < vertices.size(); ++i)
+                positions.push_back(vertices[i].Position);
+        }
+        else
+        {
+            std::vector<glm::vec3>().swap(positions);
+            std::vector<unsigned int>().swap(indices);
+        }
+        std::vector<Vertex>().swap(vertices);
+        residency = target;
 
-            // Retrieve texture number (The N in diffuse_textureN)
-            std::string number;
-            std::string name = textures[i].type;
+        ResourceRegistry::record(ownerId, RESOURCE_MESH_DATA, cpuBytes());
+    }
 
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++);
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++);
-            else if(name == "texture_height")
-                number = std::to_string(heightNr++);
+    // Bytes of CPU-side mesh data currently held
+    long long cpuBytes() const
+    {
+        return vertices.capacity() * sizeof(Vertex) + positions.capacity() * sizeof(glm::vec3) +
+               indices.capacity() * sizeof(unsigned int);
+    }
 
-            // Now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+    // Bytes per index in the element buffer
+    unsigned int indexSize() const
+    {
+        return indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+    }
 
-            // And finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
-        }
+    // Coarsest LOD whose projected error stays within the selection's budget
+    unsigned int selectLod(const LodSelection &selection, const glm::mat4 &model) const
+    {
+        if(lods.size() < 2)
+            return 0;
+
+        float pixelScale = selection.pixelScale(bounds, model);
+        unsigned int lod = 0;
+        while(lod + 1 < lods.size() && lods[lod + 1].error * pixelScale <= selection.maxPixelError)
+            ++lod;
+        return lod;
+    }
+
+    // ---------------
+    // Render the mesh
+    // ---------------
+    void Draw(Shader &shader, unsigned int lod = 0)
+    {
+        bindMaterial(shader);
 
         // Draw mesh
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+        glDrawElements(GL_TRIANGLES, lods[lod].indexCount, indexType, (void*)(std::size_t)(lods[lod].firstIndex * indexSize()));
         glBindVertexArray(0);
 
         // Always good practice to set everything back to defaults once configured.
         glActiveTexture(GL_TEXTURE0);
     }
 
+    // Draws LOD 0 without the meshlets the frustum culls. Meshlets are contiguous in the element buffer, so runs
+    // of visible ones merge into a single range of the multi-draw.
+    void DrawMeshlets(Shader &shader, const MeshletFrustum &frustum)
+    {
+        if(meshlets.empty())
+        {
+            Draw(shader);
+            return;
+        }
+
+        // Both were reserved for every meshlet, so this never allocates
+        drawCounts.clear();
+        drawOffsets.clear();
+        unsigned int runEnd = 0;
+        for(unsigned int i = 0; i < meshlets.size(); ++i)
+        {
+            const Meshlet &meshlet = meshlets[i];
+            if(!frustum.visible(meshlet))
+                continue;
+
+            if(!drawCounts.empty() && meshlet.firstIndex == runEnd)
+            {
+                drawCounts.back() += meshlet.indexCount;
+            }
+            else
+            {
+                drawCounts.push_back(meshlet.indexCount);
+                drawOffsets.push_back((const void*)(std::size_t)(meshlet.firstIndex * indexSize()));
+            }
+            runEnd = meshlet.firstIndex + meshlet.indexCount;
+        }
+
+        if(drawCounts.empty())
+            return;
+
+        bindMaterial(shader);
+
+        glBindVertexArray(VAO);
+        glMultiDrawElements(GL_TRIANGLES, drawCounts.data(), indexType, drawOffsets.data(), static_cast<GLsizei>(drawCounts.size()));
+        glBindVertexArray(0);
+
+        glActiveTexture(GL_TEXTURE0);
+    }
+
 private:
     // Render data
     unsigned int VBO, EBO;
+    unsigned int boneVBO;       // Only created for skinned layouts
+
+    // Position decode for the vertex shader (position = offset + stored * scale)
+    glm::vec3 positionScale;
+    glm::vec3 positionOffset;
+
+    // Resource registry owner (the model this mesh was loaded for)
+    int ownerId;
+
+    // Sampler uniform name for each texture (e.g. texture_diffuse1), built once so Draw doesn't allocate
+    std::vector<std::string> samplerNames;
+
+    // Ranges of visible meshlets for glMultiDrawElements, rebuilt by every DrawMeshlets
+    std::vector<GLsizei> drawCounts;
+    std::vector<const void*> drawOffsets;
+
+    // Binds the textures and sets the per-mesh uniforms
+    void bindMaterial(Shader &shader)
+    {
+        // Bind appropriate textures
+        // -------------------------
+        for(unsigned int i = 0; i < textures.size(); ++i)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);      // Activate the proper texture unit before binding
+
+            // Now set the sampler to the correct texture unit
+            shader.setInt(samplerNames[i].c_str(), i);
+
+            // And finally bind the texture
+            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        }
+
+        // Tell the vertex shader how to decode the compact formats
+        shader.setVec3("positionScale", positionScale);
+        shader.setVec3("positionOffset", positionOffset);
+        shader.setBool("octahedralNormals", Layout::OCTAHEDRAL_NORMALS);
+    }
+
+    void setupSamplerNames()
+    {
+        buildSamplerNames(textures, samplerNames);
+    }
+
+    static MeshData makeMeshData(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices)
+    {
+        MeshData data;
+        data.vertices = vertices.data();
+        data.vertexCount = static_cast<unsigned int>(vertices.size());
+        data.indices = indices.data();
+        data.indexCount = static_cast<unsigned int>(indices.size());
+        data.bones = nullptr;
+        data.lods = nullptr;
+        data.lodCount = 0;
+        data.meshlets = nullptr;
+        data.meshletCount = 0;
+        return data;
+    }
+
+    void setupLods(const MeshData &data)
+    {
+        if(data.lodCount == 0)
+        {
+            MeshLod lod = { 0, data.indexCount, 0.0f };
+            lods.push_back(lod);
+        }
+        else
+        {
+            lods.assign(data.lods, data.lods + data.lodCount);
+        }
+    }
+
+    void setupMeshlets(const MeshData &data)
+    {
+        if(data.meshletCount == 0)
+            return;
+
+        meshlets.assign(data.meshlets, data.meshlets + data.meshletCount);
+        drawCounts.reserve(data.meshletCount);
+        drawOffsets.reserve(data.meshletCount);
+        ResourceRegistry::record(ownerId, RESOURCE_MESH_DATA, meshlets.capacity() * sizeof(Meshlet) +
+                                 drawCounts.capacity() * sizeof(GLsizei) + drawOffsets.capacity() * sizeof(const void*));
+    }
+
+    void computeBounds(const MeshData &data)
+    {
+        bounds.min = bounds.max = data.vertexCount > 0 ? data.vertices[0].Position : glm::vec3(0.0f);
+        for(unsigned int i = 1; i < data.vertexCount; ++i)
+        {
+            bounds.min = glm::min(bounds.min, data.vertices[i].Position);
+            bounds.max = glm::max(bounds.max, data.vertices[i].Position);
+        }
+        Layout::positionDequantization(bounds, positionScale, positionOffset);
+    }
 
     // Initialized all the buffer objects/arrays
-    void setupMesh()
+    void setupMesh(const MeshData &data)
     {
         // Create buffers / arrays
         glGenVertexArrays(1, &VAO);
@@ -122,50 +340,69 @@ private:
 
         glBindVertexArray(VAO);
 
-        // Load data into vertex buffers
+        // Load data into vertex buffers, encoded for the layout
+        typedef typename Layout::StoredVertex StoredVertex;
+        std::vector<StoredVertex> storage;
+        const StoredVertex* vertexData = Layout::encode(data.vertices, data.vertexCount, bounds, storage);
+
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, data.vertexCount * sizeof(StoredVertex), vertexData, GL_STATIC_DRAW);
+        ResourceRegistry::record(ownerId, RESOURCE_VERTEX_BUFFER, data.vertexCount * sizeof(StoredVertex));
 
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again trainslates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        // Set the vertex attribute pointers (generated from the layout)
+        Layout::Attributes::enable(sizeof(StoredVertex));
 
+        // Every LOD lives in the one element buffer
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // Set the vertex attribute pointers
-        // ---------------------------------
-
-        // Vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-
-        // Vertex Normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        if(indexType == GL_UNSIGNED_SHORT)
+        {
+            std::vector<unsigned short> shortIndices(data.indices, data.indices + data.indexCount);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indexCount * sizeof(unsigned short), shortIndices.data(), GL_STATIC_DRAW);
+        }
+        else
+        {
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indexCount * sizeof(unsigned int), data.indices, GL_STATIC_DRAW);
+        }
+        ResourceRegistry::record(ownerId, RESOURCE_INDEX_BUFFER, data.indexCount * indexSize());
 
-        // Vertex Texture Coordinates
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        // Bone ids / weights go in their own stream so static layouts don't pay for them
+        boneVBO = 0;
+        if(Layout::SKINNED && data.bones != nullptr)
+        {
+            glGenBuffers(1, &boneVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, boneVBO);
+            glBufferData(GL_ARRAY_BUFFER, data.vertexCount * sizeof(VertexBoneData), data.bones, GL_STATIC_DRAW);
+            ResourceRegistry::record(ownerId, RESOURCE_VERTEX_BUFFER, data.vertexCount * sizeof(VertexBoneData));
 
-        // Vertex Tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+            Layout::BoneAttributes::enable(sizeof(VertexBoneData));
+        }
 
-        // Vertex Bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        glBindVertexArray(0);
+    }
 
-            // ids
-            glEnableVertexAttribArray(5);
-            glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
+    // Copies the CPU-side data the residency asks us to keep (the GPU already has its own copy)
+    void retainCpuData(const MeshData &data)
+    {
+        if(residency == RESIDENCY_KEEP_ALL)
+        {
+            vertices.assign(data.vertices, data.vertices + data.vertexCount);
+        }
+        else if(residency == RESIDENCY_POSITIONS_ONLY)
+        {
+            positions.reserve(data.vertexCount);
+            for(unsigned int i = 0; i < data.vertexCount; ++i)
+                positions.push_back(data.vertices[i].Position);
+        }
 
-            // weight
-            glEnableVertexAttribArray(6);
-            glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
+        if(residency != RESIDENCY_DISCARD)
+            indices.assign(data.indices, data.indices + indexCount);
 
-        glBindVertexArray(0);
+        ResourceRegistry::record(ownerId, RESOURCE_MESH_DATA, cpuBytes());
     }
 };
 
+// The mesh types the renderer uses
+typedef BasicMesh<StaticLayout> Mesh;
+typedef BasicMesh<SkinnedLayout<StaticLayout>> SkinnedMesh;
+
 #endif
\ No newline at end of file
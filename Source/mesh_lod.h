@@ -0,0 +1,58 @@
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include <glm/glm.hpp>
+
+#include "vertex_format.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Meshes carry at most this many LODs, LOD 0 being the full detail mesh
+#define MAX_MESH_LODS 4
+
+// LODs stop once they would have fewer triangles than this
+#define MIN_LOD_TRIANGLES 32
+
+// One level of detail: a range of the mesh's index buffer
+struct MeshLod
+{
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    float error;                // Largest model space deviation from LOD 0
+};
+
+// Per pass LOD selection: a LOD is used when its error, projected to the screen, stays under maxPixelError
+// --------------------------------------------------------------------------------------------------------
+struct LodSelection
+{
+    glm::vec3 cameraPosition;
+    float pixelsPerUnit;        // Screen size in pixels of one unit seen at unit distance
+    float maxPixelError;
+
+    LodSelection() : cameraPosition(0.0f), pixelsPerUnit(0.0f), maxPixelError(0.0f) {}
+
+    // The projection's [1][1] is 1 / tan(fovy / 2)
+    LodSelection(const glm::vec3 &cameraPosition, const glm::mat4 &projection, unsigned int viewportHeight, float maxPixelError)
+        : cameraPosition(cameraPosition), pixelsPerUnit(projection[1][1] * viewportHeight * 0.5f), maxPixelError(maxPixelError)
+    {
+    }
+
+    // Pixels a model space unit of the given mesh covers at its closest point to the camera
+    float pixelScale(const MeshBounds &bounds, const glm::mat4 &model) const
+    {
+        // Largest axis scale of the model matrix
+        float scale = std::sqrt(std::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+                                std::max(glm::dot(glm::vec3(model[1]), glm::vec3(model[1])),
+                                         glm::dot(glm::vec3(model[2]), glm::vec3(model[2])))));
+
+        glm::vec3 center = glm::vec3(model * glm::vec4(bounds.center(), 1.0f));
+        float radius = glm::length(bounds.extent()) * scale;
+        float distance = glm::length(center - cameraPosition) - radius;
+        if(distance <= 0.0f)
+            return HUGE_VALF;      // Camera inside the bounds, always full detail
+        return scale * pixelsPerUnit / distance;
+    }
+};
+
+#endif
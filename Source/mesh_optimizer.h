@@ -0,0 +1,399 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include "vertex_format.h"
+#include "scratch_arena.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Import-time mesh optimization: welds identical vertices, reorders triangles for the post-transform vertex
+// cache (Tipsify, Sander et al. 2007) and then for overdraw, and finally reorders vertices for fetch locality.
+// Everything works in place on import arrays; temporaries come from the import scratch arena.
+// ------------------------------------------------------------------------------------------------------------
+
+// Entries of the simulated post-transform cache (FIFO), typical for current GPUs
+#define VERTEX_CACHE_SIZE 16
+
+struct MeshOptimizationStats
+{
+    unsigned int verticesBefore;
+    unsigned int verticesAfter;
+    float acmrBefore;           // Average cache miss ratio: transformed vertices per triangle (0.5 is ideal, 3 is worst)
+    float acmrAfter;
+};
+
+// Simulates a FIFO vertex cache over the index buffer and returns the average cache miss ratio
+inline float computeACMR(const unsigned int* indices, unsigned int indexCount, unsigned int vertexCount,
+                         ScratchArena &scratch, unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+    if(indexCount < 3)
+        return 0.0f;
+
+    // A vertex is in the cache when it was (re)loaded less than cacheSize misses ago
+    unsigned int* loadedAt = scratch.allocate<unsigned int>(vertexCount);
+    for(unsigned int i = 0; i < vertexCount; ++i)
+        loadedAt[i] = 0;
+
+    unsigned int misses = 0;
+    for(unsigned int i = 0; i < indexCount; ++i)
+    {
+        unsigned int v = indices[i];
+        if(loadedAt[v] == 0 || misses - loadedAt[v] >= cacheSize)
+        {
+            ++misses;
+            loadedAt[v] = misses;
+        }
+    }
+    return static_cast<float>(misses) / (indexCount / 3);
+}
+
+// Merges bitwise identical vertices (including their bone data) and rewrites the indices, shrinking vertexCount
+inline void weldVertices(Vertex* vertices, VertexBoneData* bones, unsigned int &vertexCount, unsigned int* indices,
+                         unsigned int indexCount, ScratchArena &scratch)
+{
+    const unsigned int empty = ~0u;
+
+    unsigned int tableSize = 1;
+    while(tableSize < vertexCount * 2)
+        tableSize *= 2;
+    unsigned int* table = scratch.allocate<unsigned int>(tableSize);
+    for(unsigned int i = 0; i < tableSize; ++i)
+        table[i] = empty;
+
+    unsigned int* remap = scratch.allocate<unsigned int>(vertexCount);
+    unsigned int unique = 0;
+    for(unsigned int i = 0; i < vertexCount; ++i)
+    {
+        // FNV-1a over the vertex bytes (Vertex is all floats, so there is no padding)
+        unsigned int hash = 2166136261u;
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&vertices[i]);
+        for(unsigned int b = 0; b < sizeof(Vertex); ++b)
+            hash = (hash ^ bytes[b]) * 16777619u;
+        if(bones != nullptr)
+        {
+            bytes = reinterpret_cast<const unsigned char*>(&bones[i]);
+            for(unsigned int b = 0; b < sizeof(VertexBoneData); ++b)
+                hash = (hash ^ bytes[b]) * 16777619u;
+        }
+
+        // Linear probing, compacting unique vertices to the front as we go
+        unsigned int slot = hash & (tableSize - 1);
+        while(true)
+        {
+            unsigned int existing = table[slot];
+            if(existing == empty)
+            {
+                table[slot] = unique;
+                vertices[unique] = vertices[i];
+                if(bones != nullptr)
+                    bones[unique] = bones[i];
+                remap[i] = unique++;
+                break;
+            }
+            if(std::memcmp(&vertices[existing], &vertices[i], sizeof(Vertex)) == 0 &&
+               (bones == nullptr || std::memcmp(&bones[existing], &bones[i], sizeof(VertexBoneData)) == 0))
+            {
+                remap[i] = existing;
+                break;
+            }
+            slot = (slot + 1) & (tableSize - 1);
+        }
+    }
+
+    for(unsigned int i = 0; i < indexCount; ++i)
+        indices[i] = remap[indices[i]];
+    vertexCount = unique;
+}
+
+// Tipsify: fans around a vertex while it is still cache resident, and picks the next fanning vertex among the
+// ones just emitted. Writes the reordered triangles to the indices and the cluster boundaries (triangle indices
+// where the cache was effectively flushed) to clusterStarts, returning the number of clusters.
+inline unsigned int tipsifyTriangles(unsigned int* indices, unsigned int indexCount, unsigned int vertexCount,
+                                     unsigned int* clusterStarts, ScratchArena &scratch,
+                                     unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+    unsigned int triangleCount = indexCount / 3;
+    if(triangleCount == 0)
+        return 0;
+
+    // Vertex -> triangle adjacency
+    unsigned int* liveTriangles = scratch.allocate<unsigned int>(vertexCount);
+    unsigned int* adjacencyStart = scratch.allocate<unsigned int>(vertexCount + 1);
+    unsigned int* adjacency = scratch.allocate<unsigned int>(indexCount);
+    for(unsigned int i = 0; i < vertexCount; ++i)
+        liveTriangles[i] = 0;
+    for(unsigned int i = 0; i < indexCount; ++i)
+        ++liveTriangles[indices[i]];
+    adjacencyStart[0] = 0;
+    for(unsigned int i = 0; i < vertexCount; ++i)
+        adjacencyStart[i + 1] = adjacencyStart[i] + liveTriangles[i];
+    unsigned int* fill = scratch.allocate<unsigned int>(vertexCount);
+    std::memcpy(fill, adjacencyStart, vertexCount * sizeof(unsigned int));
+    for(unsigned int i = 0; i < indexCount; ++i)
+        adjacency[fill[indices[i]]++] = i / 3;
+
+    unsigned int* cacheTime = scratch.allocate<unsigned int>(vertexCount);
+    for(unsigned int i = 0; i < vertexCount; ++i)
+        cacheTime[i] = 0;
+    bool* emitted = scratch.allocate<bool>(triangleCount);
+    for(unsigned int i = 0; i < triangleCount; ++i)
+        emitted[i] = false;
+
+    unsigned int* deadEnds = scratch.allocate<unsigned int>(indexCount);
+    unsigned int deadEndCount = 0;
+    unsigned int* candidates = scratch.allocate<unsigned int>(indexCount);
+    unsigned int* output = scratch.allocate<unsigned int>(indexCount);
+    unsigned int outputCount = 0;
+
+    unsigned int time = cacheSize + 1;
+    unsigned int cursor = 0;
+    unsigned int clusterCount = 0;
+    int fanning = 0;
+    bool newCluster = true;
+
+    while(fanning >= 0)
+    {
+        if(newCluster)
+        {
+            clusterStarts[clusterCount++] = outputCount / 3;
+            newCluster = false;
+        }
+
+        // Emit every remaining triangle around the fanning vertex
+        unsigned int candidateCount = 0;
+        for(unsigned int a = adjacencyStart[fanning]; a < adjacencyStart[fanning + 1]; ++a)
+        {
+            unsigned int triangle = adjacency[a];
+            if(emitted[triangle])
+                continue;
+
+            for(unsigned int j = 0; j < 3; ++j)
+            {
+                unsigned int v = indices[triangle * 3 + j];
+                output[outputCount++] = v;
+                deadEnds[deadEndCount++] = v;
+                candidates[candidateCount++] = v;
+                --liveTriangles[v];
+                if(time - cacheTime[v] > cacheSize)
+                    cacheTime[v] = time++;
+            }
+            emitted[triangle] = true;
+        }
+
+        // Next fanning vertex: the candidate that stays in cache the longest after its own fan
+        int best = -1;
+        int bestPriority = -1;
+        for(unsigned int c = 0; c < candidateCount; ++c)
+        {
+            unsigned int v = candidates[c];
+            if(liveTriangles[v] == 0)
+                continue;
+
+            int priority = 0;
+            if(time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+                priority = static_cast<int>(time - cacheTime[v]);
+            if(priority > bestPriority)
+            {
+                bestPriority = priority;
+                best = static_cast<int>(v);
+            }
+        }
+
+        // Dead end: back up through recently used vertices, then scan for any vertex with triangles left
+        if(best == -1)
+        {
+            while(deadEndCount > 0 && best == -1)
+            {
+                unsigned int v = deadEnds[--deadEndCount];
+                if(liveTriangles[v] > 0)
+                    best = static_cast<int>(v);
+            }
+            while(best == -1 && cursor < vertexCount)
+            {
+                if(liveTriangles[cursor] > 0)
+                {
+                    best = static_cast<int>(cursor);
+                    newCluster = true;
+                }
+                ++cursor;
+            }
+        }
+        fanning = best;
+    }
+
+    std::memcpy(indices, output, outputCount * sizeof(unsigned int));
+    return clusterCount;
+}
+
+// Reorders triangles for the vertex cache only (e.g. for simplified LODs, where overdraw order matters less)
+inline void optimizeVertexCache(unsigned int* indices, unsigned int indexCount, unsigned int vertexCount, ScratchArena &scratch)
+{
+    unsigned int* clusterStarts = scratch.allocate<unsigned int>(indexCount / 3 + 1);
+    tipsifyTriangles(indices, indexCount, vertexCount, clusterStarts, scratch);
+}
+
+// Splits clusters further wherever a triangle misses the cache on all three vertices (the cache is cold there
+// anyway, so the cut costs nothing), giving the overdraw pass more freedom. Returns the new cluster count.
+inline unsigned int splitClustersOnCacheFlush(const unsigned int* indices, unsigned int indexCount, unsigned int vertexCount,
+                                              unsigned int* clusterStarts, unsigned int clusterCount, ScratchArena &scratch,
+                                              unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+    unsigned int triangleCount = indexCount / 3;
+    unsigned int* loadedAt = scratch.allocate<unsigned int>(vertexCount);
+    for(unsigned int i = 0; i < vertexCount; ++i)
+        loadedAt[i] = 0;
+    bool* boundary = scratch.allocate<bool>(triangleCount + 1);
+    for(unsigned int i = 0; i <= triangleCount; ++i)
+        boundary[i] = false;
+    for(unsigned int c = 0; c < clusterCount; ++c)
+        boundary[clusterStarts[c]] = true;
+
+    unsigned int misses = 0;
+    for(unsigned int t = 0; t < triangleCount; ++t)
+    {
+        unsigned int triangleMisses = 0;
+        for(unsigned int j = 0; j < 3; ++j)
+        {
+            unsigned int v = indices[t * 3 + j];
+            if(loadedAt[v] == 0 || misses - loadedAt[v] >= cacheSize)
+            {
+                ++misses;
+                ++triangleMisses;
+                loadedAt[v] = misses;
+            }
+        }
+        if(triangleMisses == 3)
+            boundary[t] = true;
+    }
+
+    clusterCount = 0;
+    for(unsigned int t = 0; t < triangleCount; ++t)
+    {
+        if(boundary[t])
+            clusterStarts[clusterCount++] = t;
+    }
+    return clusterCount;
+}
+
+// Orders the clusters so outward facing, outer ones draw first, which lets early depth testing reject more of
+// what follows. Sort key is dot(cluster centroid - mesh centroid, cluster normal), in descending order.
+inline void optimizeOverdraw(unsigned int* indices, unsigned int indexCount, const Vertex* vertices, unsigned int vertexCount,
+                             const unsigned int* clusterStarts, unsigned int clusterCount, ScratchArena &scratch)
+{
+    unsigned int triangleCount = indexCount / 3;
+    if(clusterCount < 2)
+        return;
+
+    glm::vec3 meshCentroid(0.0f);
+    for(unsigned int i = 0; i < vertexCount; ++i)
+        meshCentroid += vertices[i].Position;
+    meshCentroid /= static_cast<float>(vertexCount);
+
+    float* sortKeys = scratch.allocate<float>(clusterCount);
+    unsigned int* order = scratch.allocate<unsigned int>(clusterCount);
+    for(unsigned int c = 0; c < clusterCount; ++c)
+    {
+        unsigned int end = c + 1 < clusterCount ? clusterStarts[c + 1] : triangleCount;
+
+        // Area weighted centroid and normal
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for(unsigned int t = clusterStarts[c]; t < end; ++t)
+        {
+            glm::vec3 p0 = vertices[indices[t * 3 + 0]].Position;
+            glm::vec3 p1 = vertices[indices[t * 3 + 1]].Position;
+            glm::vec3 p2 = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 cross = glm::cross(p1 - p0, p2 - p0);
+            float triangleArea = glm::length(cross);
+            centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+            normal += cross;
+            area += triangleArea;
+        }
+        if(area > 0.0f)
+            centroid /= area;
+        float normalLength = glm::length(normal);
+        if(normalLength > 0.0f)
+            normal /= normalLength;
+
+        sortKeys[c] = glm::dot(centroid - meshCentroid, normal);
+        order[c] = c;
+    }
+
+    std::stable_sort(order, order + clusterCount, [sortKeys](unsigned int a, unsigned int b) { return sortKeys[a] > sortKeys[b]; });
+
+    unsigned int* output = scratch.allocate<unsigned int>(indexCount);
+    unsigned int outputCount = 0;
+    for(unsigned int i = 0; i < clusterCount; ++i)
+    {
+        unsigned int c = order[i];
+        unsigned int end = c + 1 < clusterCount ? clusterStarts[c + 1] : triangleCount;
+        for(unsigned int t = clusterStarts[c]; t < end; ++t)
+        {
+            output[outputCount++] = indices[t * 3 + 0];
+            output[outputCount++] = indices[t * 3 + 1];
+            output[outputCount++] = indices[t * 3 + 2];
+        }
+    }
+    std::memcpy(indices, output, indexCount * sizeof(unsigned int));
+}
+
+// Renumbers vertices in the order the index buffer first uses them, so vertex fetch walks memory linearly.
+// Vertices no triangle references are dropped.
+inline void optimizeVertexFetch(Vertex* vertices, VertexBoneData* bones, unsigned int &vertexCount, unsigned int* indices,
+                                unsigned int indexCount, ScratchArena &scratch)
+{
+    const unsigned int unassigned = ~0u;
+
+    unsigned int* remap = scratch.allocate<unsigned int>(vertexCount);
+    for(unsigned int i = 0; i < vertexCount; ++i)
+        remap[i] = unassigned;
+
+    Vertex* reordered = scratch.allocate<Vertex>(vertexCount);
+    VertexBoneData* reorderedBones = bones != nullptr ? scratch.allocate<VertexBoneData>(vertexCount) : nullptr;
+    unsigned int used = 0;
+    for(unsigned int i = 0; i < indexCount; ++i)
+    {
+        unsigned int v = indices[i];
+        if(remap[v] == unassigned)
+        {
+            remap[v] = used;
+            reordered[used] = vertices[v];
+            if(bones != nullptr)
+                reorderedBones[used] = bones[v];
+            ++used;
+        }
+        indices[i] = remap[v];
+    }
+
+    std::memcpy(vertices, reordered, used * sizeof(Vertex));
+    if(bones != nullptr)
+        std::memcpy(bones, reorderedBones, used * sizeof(VertexBoneData));
+    vertexCount = used;
+}
+
+// Runs the whole optimization stage on one imported mesh
+inline MeshOptimizationStats optimizeMesh(Vertex* vertices, VertexBoneData* bones, unsigned int &vertexCount,
+                                          unsigned int* indices, unsigned int indexCount, ScratchArena &scratch)
+{
+    MeshOptimizationStats stats;
+    stats.verticesBefore = vertexCount;
+    stats.acmrBefore = computeACMR(indices, indexCount, vertexCount, scratch);
+
+    weldVertices(vertices, bones, vertexCount, indices, indexCount, scratch);
+
+    unsigned int* clusterStarts = scratch.allocate<unsigned int>(indexCount / 3 + 1);
+    unsigned int clusterCount = tipsifyTriangles(indices, indexCount, vertexCount, clusterStarts, scratch);
+    clusterCount = splitClustersOnCacheFlush(indices, indexCount, vertexCount, clusterStarts, clusterCount, scratch);
+    optimizeOverdraw(indices, indexCount, vertices, vertexCount, clusterStarts, clusterCount, scratch);
+
+    optimizeVertexFetch(vertices, bones, vertexCount, indices, indexCount, scratch);
+
+    stats.verticesAfter = vertexCount;
+    stats.acmrAfter = computeACMR(indices, indexCount, vertexCount, scratch);
+    return stats;
+}
+
+#endif
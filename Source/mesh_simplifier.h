@@ -0,0 +1,307 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <glm/glm.hpp>
+
+#include "vertex_format.h"
+#include "scratch_arena.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+// Quadric error edge collapse simplification (Garland & Heckbert 1997), index buffer only: vertices collapse
+// onto existing vertices, so every LOD indexes the same vertex buffer. Vertices on UV / normal seams (several
+// vertices sharing a position) and on open borders are locked, which keeps seams and silhouettes of open
+// meshes intact; everything else may collapse onto a neighbour.
+// ---------------------------------------------------------------------------------------------------------
+
+// Sum of squared distances to a set of planes, as a symmetric 4x4 matrix
+struct Quadric
+{
+    float a2, b2, c2, d2;
+    float ab, ac, ad;
+    float bc, bd;
+    float cd;
+    float weight;
+};
+
+inline void quadricFromPlane(Quadric &q, const glm::vec3 &normal, float d, float weight)
+{
+    q.a2 = normal.x * normal.x * weight;
+    q.b2 = normal.y * normal.y * weight;
+    q.c2 = normal.z * normal.z * weight;
+    q.d2 = d * d * weight;
+    q.ab = normal.x * normal.y * weight;
+    q.ac = normal.x * normal.z * weight;
+    q.ad = normal.x * d * weight;
+    q.bc = normal.y * normal.z * weight;
+    q.bd = normal.y * d * weight;
+    q.cd = normal.z * d * weight;
+    q.weight = weight;
+}
+
+inline void quadricAdd(Quadric &q, const Quadric &other)
+{
+    q.a2 += other.a2; q.b2 += other.b2; q.c2 += other.c2; q.d2 += other.d2;
+    q.ab += other.ab; q.ac += other.ac; q.ad += other.ad;
+    q.bc += other.bc; q.bd += other.bd;
+    q.cd += other.cd;
+    q.weight += other.weight;
+}
+
+// Area weighted mean squared distance from p to the quadric's planes
+inline float quadricError(const Quadric &q, const glm::vec3 &p)
+{
+    float rx = q.a2 * p.x + q.ab * p.y + q.ac * p.z;
+    float ry = q.ab * p.x + q.b2 * p.y + q.bc * p.z;
+    float rz = q.ac * p.x + q.bc * p.y + q.c2 * p.z;
+    float error = rx * p.x + ry * p.y + rz * p.z + 2.0f * (q.ad * p.x + q.bd * p.y + q.cd * p.z) + q.d2;
+    return q.weight > 0.0f ? std::fabs(error) / q.weight : 0.0f;
+}
+
+// Simplifies the triangles in indices towards targetIndexCount, without exceeding maxError (a model space
+// distance). Writes the result to destination (which must hold indexCount indices), returns its index count and
+// stores the largest deviation introduced in resultError.
+inline unsigned int simplifyMesh(unsigned int* destination, const unsigned int* indices, unsigned int indexCount,
+                                 const Vertex* vertices, unsigned int vertexCount, unsigned int targetIndexCount,
+                                 float maxError, float &resultError, ScratchArena &scratch)
+{
+    const unsigned int empty = ~0u;
+    resultError = 0.0f;
+
+    std::memcpy(destination, indices, indexCount * sizeof(unsigned int));
+    if(indexCount <= targetIndexCount)
+        return indexCount;
+
+    // Group vertices by position: the first vertex at a position stands for all of them
+    // ----------------------------------------------------------------------------------
+    unsigned int tableSize = 1;
+    while(tableSize < vertexCount * 2)
+        tableSize *= 2;
+    unsigned int* table = scratch.allocate<unsigned int>(tableSize);
+    for(unsigned int i = 0; i < tableSize; ++i)
+        table[i] = empty;
+
+    unsigned int* canonical = scratch.allocate<unsigned int>(vertexCount);
+    bool* locked = scratch.allocate<bool>(vertexCount);
+    for(unsigned int i = 0; i < vertexCount; ++i)
+    {
+        const glm::vec3 &p = vertices[i].Position;
+        unsigned int hash = 2166136261u;
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&p);
+        for(unsigned int b = 0; b < sizeof(glm::vec3); ++b)
+            hash = (hash ^ bytes[b]) * 16777619u;
+
+        unsigned int slot = hash & (tableSize - 1);
+        while(table[slot] != empty && vertices[table[slot]].Position != p)
+            slot = (slot + 1) & (tableSize - 1);
+
+        locked[i] = false;
+        if(table[slot] == empty)
+        {
+            table[slot] = i;
+            canonical[i] = i;
+        }
+        else
+        {
+            // A second vertex at the same position: a seam, lock both sides
+            canonical[i] = table[slot];
+            locked[i] = true;
+            locked[table[slot]] = true;
+        }
+    }
+
+    // Lock open borders: directed edges (between positions) without their reverse
+    // ---------------------------------------------------------------------------
+    unsigned int edgeTableSize = 1;
+    while(edgeTableSize < indexCount * 2)
+        edgeTableSize *= 2;
+    unsigned long long* edges = scratch.allocate<unsigned long long>(edgeTableSize);
+    const unsigned long long noEdge = ~0ull;
+    for(unsigned int i = 0; i < edgeTableSize; ++i)
+        edges[i] = noEdge;
+
+    for(int pass = 0; pass < 2; ++pass)
+    {
+        for(unsigned int i = 0; i < indexCount; ++i)
+        {
+            unsigned int from = canonical[indices[i]];
+            unsigned int to = canonical[indices[i - i % 3 + (i + 1) % 3]];
+            unsigned long long key = pass == 0 ? (static_cast<unsigned long long>(from) << 32 | to)
+                                               : (static_cast<unsigned long long>(to) << 32 | from);
+            unsigned int slot = static_cast<unsigned int>((key * 0x9E3779B97F4A7C15ull) >> 32) & (edgeTableSize - 1);
+            while(edges[slot] != noEdge && edges[slot] != key)
+                slot = (slot + 1) & (edgeTableSize - 1);
+
+            if(pass == 0)
+            {
+                edges[slot] = key;
+            }
+            else if(edges[slot] == noEdge)
+            {
+                // The reverse edge doesn't exist
+                locked[from] = true;
+                locked[to] = true;
+            }
+        }
+    }
+    for(unsigned int i = 0; i < vertexCount; ++i)
+    {
+        if(locked[canonical[i]])
+            locked[i] = true;
+    }
+
+    // Plane quadrics, accumulated per position
+    // ----------------------------------------
+    Quadric* quadrics = scratch.allocate<Quadric>(vertexCount);
+    std::memset(quadrics, 0, vertexCount * sizeof(Quadric));
+    for(unsigned int i = 0; i < indexCount; i += 3)
+    {
+        glm::vec3 p0 = vertices[indices[i + 0]].Position;
+        glm::vec3 p1 = vertices[indices[i + 1]].Position;
+        glm::vec3 p2 = vertices[indices[i + 2]].Position;
+        glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        float area = glm::length(normal);
+        if(area == 0.0f)
+            continue;
+        normal /= area;
+
+        Quadric q;
+        quadricFromPlane(q, normal, -glm::dot(normal, p0), area);
+        for(unsigned int j = 0; j < 3; ++j)
+            quadricAdd(quadrics[canonical[indices[i + j]]], q);
+    }
+
+    // Collapse passes: pick the cheapest collapse per vertex, apply the independent ones, rebuild, repeat
+    // ----------------------------------------------------------------------------------------------------
+    unsigned int* remap = scratch.allocate<unsigned int>(vertexCount);
+    unsigned int* bestTarget = scratch.allocate<unsigned int>(vertexCount);
+    float* bestCost = scratch.allocate<float>(vertexCount);
+    bool* touched = scratch.allocate<bool>(vertexCount);
+    unsigned int* adjacencyStart = scratch.allocate<unsigned int>(vertexCount + 1);
+    unsigned int* adjacency = scratch.allocate<unsigned int>(indexCount);
+    unsigned int* candidates = scratch.allocate<unsigned int>(vertexCount);
+    float maxErrorSquared = maxError < FLT_MAX ? maxError * maxError : FLT_MAX;
+    float worstCost = 0.0f;
+
+    while(indexCount > targetIndexCount)
+    {
+        // Vertex -> triangle adjacency of the current triangles
+        for(unsigned int i = 0; i <= vertexCount; ++i)
+            adjacencyStart[i] = 0;
+        for(unsigned int i = 0; i < indexCount; ++i)
+            ++adjacencyStart[destination[i] + 1];
+        for(unsigned int i = 0; i < vertexCount; ++i)
+            adjacencyStart[i + 1] += adjacencyStart[i];
+        for(unsigned int i = 0; i < indexCount; ++i)
+            adjacency[adjacencyStart[destination[i]]++] = i / 3;
+        for(unsigned int i = vertexCount; i > 0; --i)
+            adjacencyStart[i] = adjacencyStart[i - 1];
+        adjacencyStart[0] = 0;
+
+        // Cheapest collapse for every unlocked vertex
+        for(unsigned int i = 0; i < vertexCount; ++i)
+        {
+            remap[i] = i;
+            bestCost[i] = FLT_MAX;
+            touched[i] = false;
+        }
+        for(unsigned int i = 0; i < indexCount; ++i)
+        {
+            unsigned int from = destination[i];
+            unsigned int to = destination[i - i % 3 + (i + 1) % 3];
+            for(int direction = 0; direction < 2; ++direction)
+            {
+                if(!locked[from])
+                {
+                    float cost = quadricError(quadrics[from], vertices[to].Position);
+                    if(cost < bestCost[from])
+                    {
+                        bestCost[from] = cost;
+                        bestTarget[from] = to;
+                    }
+                }
+                std::swap(from, to);
+            }
+        }
+
+        unsigned int candidateCount = 0;
+        for(unsigned int i = 0; i < vertexCount; ++i)
+        {
+            if(bestCost[i] < FLT_MAX && bestCost[i] <= maxErrorSquared)
+                candidates[candidateCount++] = i;
+        }
+        std::sort(candidates, candidates + candidateCount,
+                  [bestCost](unsigned int a, unsigned int b) { return bestCost[a] < bestCost[b]; });
+
+        // Each collapse removes about two triangles; don't overshoot the target
+        unsigned int collapseBudget = (indexCount - targetIndexCount) / 6 + 1;
+        unsigned int collapses = 0;
+        for(unsigned int c = 0; c < candidateCount && collapses < collapseBudget; ++c)
+        {
+            unsigned int from = candidates[c];
+            unsigned int to = bestTarget[from];
+            if(touched[from] || touched[to])
+                continue;
+
+            // Reject collapses that would flip a triangle around the collapsing vertex
+            bool flips = false;
+            glm::vec3 target = vertices[to].Position;
+            for(unsigned int a = adjacencyStart[from]; a < adjacencyStart[from + 1] && !flips; ++a)
+            {
+                const unsigned int* triangle = &destination[adjacency[a] * 3];
+                if(canonical[triangle[0]] == canonical[to] || canonical[triangle[1]] == canonical[to] ||
+                   canonical[triangle[2]] == canonical[to])
+                    continue;       // Becomes degenerate and goes away
+
+                glm::vec3 before[3], after[3];
+                for(unsigned int j = 0; j < 3; ++j)
+                {
+                    before[j] = vertices[triangle[j]].Position;
+                    after[j] = triangle[j] == from ? target : before[j];
+                }
+                glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+                glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+                if(glm::dot(normalBefore, normalAfter) <= 0.0f)
+                    flips = true;
+            }
+            if(flips)
+                continue;
+
+            // Collapse, and keep this vertex's neighbourhood still for the rest of the pass
+            remap[from] = to;
+            quadricAdd(quadrics[canonical[to]], quadrics[from]);
+            worstCost = std::max(worstCost, bestCost[from]);
+            ++collapses;
+            for(unsigned int a = adjacencyStart[from]; a < adjacencyStart[from + 1]; ++a)
+            {
+                const unsigned int* triangle = &destination[adjacency[a] * 3];
+                touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+            }
+        }
+        if(collapses == 0)
+            break;
+
+        // Apply the collapses, dropping triangles that became degenerate
+        unsigned int written = 0;
+        for(unsigned int i = 0; i < indexCount; i += 3)
+        {
+            unsigned int v0 = remap[destination[i + 0]];
+            unsigned int v1 = remap[destination[i + 1]];
+            unsigned int v2 = remap[destination[i + 2]];
+            if(canonical[v0] == canonical[v1] || canonical[v1] == canonical[v2] || canonical[v0] == canonical[v2])
+                continue;
+            destination[written++] = v0;
+            destination[written++] = v1;
+            destination[written++] = v2;
+        }
+        indexCount = written;
+    }
+
+    resultError = std::sqrt(worstCost);
+    return indexCount;
+}
+
+#endif
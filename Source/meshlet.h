@@ -0,0 +1,328 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <glm/glm.hpp>
+
+#include "vertex_format.h"
+#include "scratch_arena.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Meshlet size limits (the usual mesh shader sizes, so a later mesh shader path can use the same clusters)
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+// Meshes with fewer triangles are drawn whole, culling their meshlets would cost more than it saves
+#define MESHLET_MIN_MESH_TRIANGLES 512
+
+// Meshlets: small clusters of adjacent triangles, each a contiguous range of the LOD 0 indices, with a bounding
+// sphere for frustum culling and a normal cone for backface culling. Cone culling drops clusters whose triangles
+// all face away from the camera, so it is only correct for meshes that are closed or only seen from the front.
+// -------------------------------------------------------------------------------------------------------------
+struct Meshlet
+{
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    glm::vec3 center;           // Model space bounding sphere
+    float radius;
+    glm::vec3 coneAxis;         // Average facing of the triangles
+    float coneCutoff;           // Sine of the cone's half angle, 1 when the cone can't be culled
+};
+
+// Bounding sphere and normal cone of one meshlet
+inline void computeMeshletBounds(Meshlet &meshlet, const unsigned int* indices, const Vertex* vertices)
+{
+    const unsigned int* triangles = indices + meshlet.firstIndex;
+
+    glm::vec3 min = vertices[triangles[0]].Position;
+    glm::vec3 max = min;
+    for(unsigned int i = 1; i < meshlet.indexCount; ++i)
+    {
+        min = glm::min(min, vertices[triangles[i]].Position);
+        max = glm::max(max, vertices[triangles[i]].Position);
+    }
+    meshlet.center = (min + max) * 0.5f;
+
+    float radius2 = 0.0f;
+    for(unsigned int i = 0; i < meshlet.indexCount; ++i)
+    {
+        glm::vec3 offset = vertices[triangles[i]].Position - meshlet.center;
+        radius2 = std::max(radius2, glm::dot(offset, offset));
+    }
+    meshlet.radius = std::sqrt(radius2);
+
+    // Cone axis: the average of the unit face normals, the cone must then contain every one of them
+    glm::vec3 normals[MESHLET_MAX_TRIANGLES];
+    unsigned int normalCount = 0;
+    glm::vec3 axis(0.0f);
+    for(unsigned int i = 0; i + 2 < meshlet.indexCount; i += 3)
+    {
+        const glm::vec3 &p0 = vertices[triangles[i + 0]].Position;
+        glm::vec3 normal = glm::cross(vertices[triangles[i + 1]].Position - p0, vertices[triangles[i + 2]].Position - p0);
+        float length = glm::length(normal);
+        if(length == 0.0f)
+            continue;   // Degenerate, faces nowhere
+
+        normals[normalCount] = normal / length;
+        axis += normals[normalCount];
+        ++normalCount;
+    }
+
+    meshlet.coneAxis = glm::vec3(0.0f);
+    meshlet.coneCutoff = 1.0f;
+    float axisLength = glm::length(axis);
+    if(normalCount == 0 || axisLength == 0.0f)
+        return;
+    axis /= axisLength;
+
+    float minDot = 1.0f;
+    for(unsigned int i = 0; i < normalCount; ++i)
+        minDot = std::min(minDot, glm::dot(normals[i], axis));
+
+    // Cones near (or past) a hemisphere would almost never be culled
+    if(minDot <= 0.1f)
+        return;
+
+    meshlet.coneAxis = axis;
+    meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+inline glm::vec3 triangleCentroid(const unsigned int* indices, unsigned int triangle, const Vertex* vertices)
+{
+    return (vertices[indices[triangle * 3 + 0]].Position + vertices[indices[triangle * 3 + 1]].Position +
+            vertices[indices[triangle * 3 + 2]].Position) / 3.0f;
+}
+
+// Groups the triangles in indices into meshlets. Each meshlet grows from a seed triangle through triangles
+// sharing its vertices, preferring those that add the fewest new vertices and then those closest to its
+// centroid (which keeps it round, so its bounding sphere stays tight). It is closed once another triangle would
+// break the vertex or triangle limit, or when nothing connected is left. Writes the reordered triangles to
+// destination (indexCount indices) and the meshlets (at most indexCount / 3) to meshlets, and returns the
+// meshlet count.
+inline unsigned int buildMeshlets(Meshlet* meshlets, unsigned int* destination, const unsigned int* indices,
+                                  unsigned int indexCount, const Vertex* vertices, unsigned int vertexCount,
+                                  ScratchArena &scratch)
+{
+    const unsigned int none = ~0u;
+    unsigned int triangleCount = indexCount / 3;
+
+    // Triangles using each vertex
+    // ---------------------------
+    unsigned int* adjacencyOffsets = scratch.allocate<unsigned int>(vertexCount + 1);
+    unsigned int* adjacency = scratch.allocate<unsigned int>(triangleCount * 3);
+    std::fill(adjacencyOffsets, adjacencyOffsets + vertexCount + 1, 0u);
+    for(unsigned int i = 0; i < triangleCount * 3; ++i)
+        ++adjacencyOffsets[indices[i] + 1];
+    for(unsigned int v = 0; v < vertexCount; ++v)
+        adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+
+    unsigned int* fill = scratch.allocate<unsigned int>(vertexCount);
+    std::copy(adjacencyOffsets, adjacencyOffsets + vertexCount, fill);
+    for(unsigned int t = 0; t < triangleCount; ++t)
+    {
+        for(unsigned int j = 0; j < 3; ++j)
+            adjacency[fill[indices[t * 3 + j]]++] = t;
+    }
+
+    bool* emitted = scratch.allocate<bool>(triangleCount);
+    std::fill(emitted, emitted + triangleCount, false);
+
+    // Meshlet that last used each vertex, to count the new vertices a triangle adds
+    unsigned int* vertexMeshlet = scratch.allocate<unsigned int>(vertexCount);
+    std::fill(vertexMeshlet, vertexMeshlet + vertexCount, none);
+
+    unsigned int meshletCount = 0;
+    unsigned int written = 0;
+    unsigned int meshletVertices[MESHLET_MAX_VERTICES];
+    unsigned int meshletVertexCount = 0;
+    unsigned int meshletTriangles = 0;
+    glm::vec3 centroidSum(0.0f);        // Of the meshlet's triangle centroids
+    unsigned int nextSeed = 0;          // Triangles before this one are all emitted
+    unsigned int last = none;           // Triangle added last, a new meshlet starts next to it
+
+    unsigned int emittedCount = 0;
+    while(emittedCount < triangleCount)
+    {
+        // Candidates: unemitted triangles around the meshlet's vertices, or around the last triangle when the
+        // meshlet is still empty
+        const unsigned int* around = meshletVertices;
+        unsigned int aroundCount = meshletVertexCount;
+        glm::vec3 centroid = meshletTriangles > 0 ? centroidSum / float(meshletTriangles) : glm::vec3(0.0f);
+        if(meshletTriangles == 0 && last != none)
+        {
+            around = indices + last * 3;
+            aroundCount = 3;
+            centroid = triangleCentroid(indices, last, vertices);
+        }
+
+        // Fewest new vertices first, then closest to the centroid
+        unsigned int best = none;
+        unsigned int bestNew = 4;
+        float bestDistance = 0.0f;
+        for(unsigned int j = 0; j < aroundCount; ++j)
+        {
+            unsigned int v = around[j];
+            for(unsigned int a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; ++a)
+            {
+                unsigned int t = adjacency[a];
+                if(emitted[t])
+                    continue;
+
+                unsigned int newVertices = 0;
+                for(unsigned int k = 0; k < 3; ++k)
+                {
+                    if(vertexMeshlet[indices[t * 3 + k]] != meshletCount)
+                        ++newVertices;
+                }
+                if(newVertices > bestNew)
+                    continue;
+
+                glm::vec3 offset = triangleCentroid(indices, t, vertices) - centroid;
+                float distance = glm::dot(offset, offset);
+                if(newVertices < bestNew || distance < bestDistance)
+                {
+                    best = t;
+                    bestNew = newVertices;
+                    bestDistance = distance;
+                }
+            }
+        }
+
+        // Nothing connected left: close the meshlet rather than stretch its bounds over a gap, then seed the next
+        // one with the next triangle in input order (already cache and overdraw optimized)
+        if(best == none && meshletTriangles > 0)
+        {
+            meshlets[meshletCount].indexCount = meshletTriangles * 3;
+            ++meshletCount;
+            meshletVertexCount = 0;
+            meshletTriangles = 0;
+            centroidSum = glm::vec3(0.0f);
+            last = none;
+            continue;
+        }
+        if(best == none)
+        {
+            while(emitted[nextSeed])
+                ++nextSeed;
+            best = nextSeed;
+            bestNew = 0;
+            for(unsigned int k = 0; k < 3; ++k)
+            {
+                if(vertexMeshlet[indices[best * 3 + k]] != meshletCount)
+                    ++bestNew;
+            }
+        }
+
+        // Close the meshlet when the triangle doesn't fit, the next one starts around the last triangle
+        if(meshletTriangles > 0 && (meshletVertexCount + bestNew > MESHLET_MAX_VERTICES ||
+                                    meshletTriangles + 1 > MESHLET_MAX_TRIANGLES))
+        {
+            meshlets[meshletCount].indexCount = meshletTriangles * 3;
+            ++meshletCount;
+            meshletVertexCount = 0;
+            meshletTriangles = 0;
+            centroidSum = glm::vec3(0.0f);
+            continue;
+        }
+
+        if(meshletTriangles == 0)
+            meshlets[meshletCount].firstIndex = written;
+
+        for(unsigned int k = 0; k < 3; ++k)
+        {
+            unsigned int v = indices[best * 3 + k];
+            if(vertexMeshlet[v] != meshletCount)
+            {
+                vertexMeshlet[v] = meshletCount;
+                meshletVertices[meshletVertexCount++] = v;
+            }
+            destination[written++] = v;
+        }
+        emitted[best] = true;
+        centroidSum += triangleCentroid(indices, best, vertices);
+        ++meshletTriangles;
+        ++emittedCount;
+        last = best;
+    }
+
+    if(meshletTriangles > 0)
+    {
+        meshlets[meshletCount].indexCount = meshletTriangles * 3;
+        ++meshletCount;
+    }
+
+    for(unsigned int i = 0; i < meshletCount; ++i)
+        computeMeshletBounds(meshlets[i], destination, vertices);
+
+    return meshletCount;
+}
+
+// Camera of one pass, for culling meshlets
+// ----------------------------------------
+struct MeshletCulling
+{
+    glm::mat4 viewProjection;
+    glm::vec3 cameraPosition;
+    bool cullBackfaces;         // Cone culling, see the note on Meshlet
+
+    MeshletCulling(const glm::mat4 &projection, const glm::mat4 &view, const glm::vec3 &cameraPosition, bool cullBackfaces = true)
+        : viewProjection(projection * view), cameraPosition(cameraPosition), cullBackfaces(cullBackfaces)
+    {
+    }
+};
+
+// The culling camera moved into one draw's model space, so meshlet bounds are tested without transforming them
+// -------------------------------------------------------------------------------------------------------------
+struct MeshletFrustum
+{
+    glm::vec4 planes[6];        // Normalized, pointing inwards
+    glm::vec3 cameraPosition;
+    bool cullBackfaces;
+
+    MeshletFrustum(const MeshletCulling &culling, const glm::mat4 &model) : cullBackfaces(culling.cullBackfaces)
+    {
+        // Planes of the model-view-projection matrix are the frustum planes in model space (Gribb & Hartmann)
+        glm::mat4 m = culling.viewProjection * model;
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+        planes[0] = row3 + row0;
+        planes[1] = row3 - row0;
+        planes[2] = row3 + row1;
+        planes[3] = row3 - row1;
+        planes[4] = row3 + row2;
+        planes[5] = row3 - row2;
+        for(int i = 0; i < 6; ++i)
+            planes[i] /= glm::length(glm::vec3(planes[i]));
+
+        cameraPosition = glm::vec3(glm::inverse(model) * glm::vec4(culling.cameraPosition, 1.0f));
+    }
+
+    // Whether a model space sphere intersects the frustum
+    bool visible(const glm::vec3 &center, float radius) const
+    {
+        for(int i = 0; i < 6; ++i)
+        {
+            if(glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+                return false;
+        }
+        return true;
+    }
+
+    // Whether every triangle of the meshlet faces away: the camera lies inside the cone's negative space,
+    // widened by the bounding sphere
+    bool backfacing(const Meshlet &meshlet) const
+    {
+        glm::vec3 toCenter = meshlet.center - cameraPosition;
+        return glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+    }
+
+    bool visible(const Meshlet &meshlet) const
+    {
+        return visible(meshlet.center, meshlet.radius) && !(cullBackfaces && backfacing(meshlet));
+    }
+};
+
+#endif
@@ -14,7 +14,15 @@
 
 #include "mesh.h"
 #include "shader.h"
-
+#include "resource_registry.h"
+#include "scratch_arena.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "meshlet.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
 #include <vector>
 #include <string>
 #include <fstream>
@@ -24,20 +32,29 @@
 
 unsigned int TextureFromFile(const char* path, const std::string &directory, bool gamma = false);
 
-class Model
+// A model whose static meshes use the given vertex layout; meshes with bones use its skinned variant
+template<typename Layout = StaticLayout>
+class BasicModel
 {
 public:
     // Model data
     std::vector<Texture> textures_loaded;   // Store all the textures loaded so far, optimization to make sure textures
                                             // aren't loaded more than once.
-    std::vector<Mesh> meshes;
+    std::vector<BasicMesh<Layout>> meshes;
+    std::vector<BasicMesh<SkinnedLayout<Layout>>> skinnedMeshes;
     std::string directory;
     bool gammaCorrection;
+    MeshResidency residency;                // What the meshes keep in CPU memory after upload
+    bool splitLargeMeshes;                  // Split meshes too big for 16-bit indices into parts that fit
+    MeshBounds bounds;                      // Model space bounds of all meshes
 
     // Constructor, expects a filepath to a 3D model.
-    Model(std::string const &path, bool gamma = false) : gammaCorrection(gamma)
+    BasicModel(std::string const &path, bool gamma = false, MeshResidency residency = RESIDENCY_DISCARD,
+               bool splitLargeMeshes = false)
+        : gammaCorrection(gamma), residency(residency), splitLargeMeshes(splitLargeMeshes)
     {
         loadModel(path);
+        computeBounds();
     }
 
     // Draws the model, and thus all its meshes
@@ -45,6 +62,44 @@ public:
     {
         for(unsigned int i = 0; i < meshes.size(); ++i)
             meshes[i].Draw(shader);
+        for(unsigned int i = 0; i < skinnedMeshes.size(); ++i)
+            skinnedMeshes[i].Draw(shader);
+    }
+
+    // Draws every mesh at the LOD the selection picks for it under the given model matrix
+    void Draw(Shader &shader, const glm::mat4 &model, const LodSelection &selection)
+    {
+        for(unsigned int i = 0; i < meshes.size(); ++i)
+            meshes[i].Draw(shader, meshes[i].selectLod(selection, model));
+        for(unsigned int i = 0; i < skinnedMeshes.size(); ++i)
+            skinnedMeshes[i].Draw(shader, skinnedMeshes[i].selectLod(selection, model));
+    }
+
+    // As above, but static meshes drawn at LOD 0 also skip the meshlets the culling camera can't see. Skinned
+    // meshes move away from their bind pose bounds, so they are always drawn whole.
+    void Draw(Shader &shader, const glm::mat4 &model, const LodSelection &selection, const MeshletCulling &culling)
+    {
+        MeshletFrustum frustum(culling, model);
+        for(unsigned int i = 0; i < meshes.size(); ++i)
+        {
+            unsigned int lod = meshes[i].selectLod(selection, model);
+            if(lod == 0)
+                meshes[i].DrawMeshlets(shader, frustum);
+            else
+                meshes[i].Draw(shader, lod);
+        }
+        for(unsigned int i = 0; i < skinnedMeshes.size(); ++i)
+            skinnedMeshes[i].Draw(shader, skinnedMeshes[i].selectLod(selection, model));
+    }
+
+    // Drops the CPU-side data of every mesh down to the given residency
+    void releaseCpuData(MeshResidency target)
+    {
+        for(unsigned int i = 0; i < meshes.size(); ++i)
+            meshes[i].releaseCpuData(target);
+        for(unsigned int i = 0; i < skinnedMeshes.size(); ++i)
+            skinnedMeshes[i].releaseCpuData(target);
+        residency = std::min(residency, target);
     }
 
 private:
@@ -52,6 +107,9 @@ private:
     // --------------------------------------------------------------------------------------------------------------
     void loadModel(std::string const &path)
     {
+        // Everything allocated while loading is accounted to this model
+        ScopedResourceOwner owner(ResourceRegistry::owner(path));
+
         // Read file via ASSIMP
         Assimp::Importer importer;
         const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
@@ -66,14 +124,54 @@ private:
         // Retrieve the directory path of the filepath
         directory = path.substr(0, path.find_last_of('/'));
 
+        // Meshes are built in place, so size the vector once up front
+        meshes.reserve(meshes.size() + countMeshes(scene->mRootNode, scene, false));
+        skinnedMeshes.reserve(skinnedMeshes.size() + countMeshes(scene->mRootNode, scene, true));
+
+        // Per-mesh temporaries live in a scratch arena that is rewound after every mesh
+        ScratchArena scratch;
+
         // Process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        processNode(scene->mRootNode, scene, scratch);
+    }
+
+    // Union of the mesh bounds
+    void computeBounds()
+    {
+        bounds.min = glm::vec3(FLT_MAX);
+        bounds.max = glm::vec3(-FLT_MAX);
+        for(unsigned int i = 0; i < meshes.size(); ++i)
+        {
+            bounds.min = glm::min(bounds.min, meshes[i].bounds.min);
+            bounds.max = glm::max(bounds.max, meshes[i].bounds.max);
+        }
+        for(unsigned int i = 0; i < skinnedMeshes.size(); ++i)
+        {
+            bounds.min = glm::min(bounds.min, skinnedMeshes[i].bounds.min);
+            bounds.max = glm::max(bounds.max, skinnedMeshes[i].bounds.max);
+        }
+        if(meshes.empty() && skinnedMeshes.empty())
+            bounds.min = bounds.max = glm::vec3(0.0f);
+    }
+
+    // Number of static (or skinned) meshes referenced from a node and all of its children
+    unsigned int countMeshes(const aiNode* node, const aiScene* scene, bool skinned) const
+    {
+        unsigned int count = 0;
+        for(unsigned int i = 0; i < node->mNumMeshes; ++i)
+        {
+            if(scene->mMeshes[node->mMeshes[i]]->HasBones() == skinned)
+                ++count;
+        }
+        for(unsigned int i = 0; i < node->mNumChildren; ++i)
+            count += countMeshes(node->mChildren[i], scene, skinned);
+        return count;
     }
 
     // Processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats
     // this process on its children nodes (if any).
     // -------------------------------------------------------------------------------------------------------
-    void processNode(aiNode* node, const aiScene* scene)
+    void processNode(aiNode* node, const aiScene* scene, ScratchArena &scratch)
     {
         // Process each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; ++i)
@@ -81,27 +179,31 @@ private:
             // The node object only contains indices to index the actual objects in the scene
             // The scene contains all the data. Node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            processMesh(mesh, scene, scratch);
+            scratch.reset();
         }
 
         // After we've processes all of the meshes (if any), we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; ++i)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, scratch);
         }
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    // Converts an ASSIMP mesh and appends it to meshes. Vertices and indices are written exactly once, into
+    // scratch memory sized from mNumVertices / mNumFaces, and uploaded from there without further copies.
+    void processMesh(aiMesh *mesh, const aiScene *scene, ScratchArena &scratch)
     {
         // Data to fill
-        std::vector<Vertex> vertices;
-        std::vector<unsigned int> indices;
+        Vertex* vertices = scratch.allocate<Vertex>(mesh->mNumVertices);
+        unsigned int* indices = scratch.allocate<unsigned int>(mesh->mNumFaces * 3);    // Faces are triangulated
+        unsigned int indexCount = 0;
         std::vector<Texture> textures;
 
         // Walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; ++i)
         {
-            Vertex vertex;
+            Vertex vertex = Vertex();
             glm::vec3 vector;       // We declare a placeholder vector since assimp uses its own vector class that
                                     // doesn't directly convert to glm's vec3 class so we transfer the data to this
                                     // placeholder glm::vec3 first.
@@ -147,25 +249,195 @@ private:
             {
                 vertex.TexCoords = glm::vec2(0.0f, 0.0f);
             }
-            vertices.push_back(vertex);
+            new (&vertices[i]) Vertex(vertex);
         }
 
+        // Skinning data, only for meshes that actually have bones
+        VertexBoneData* bones = mesh->HasBones() ? loadBoneWeights(mesh, scratch) : nullptr;
+
         // Now walk through each of the mesh's face (a face is a mesh its triangle)
         // and retrieve the corresponding vertex indices.
         for(unsigned int i = 0; i < mesh->mNumFaces; ++i)
         {
-            aiFace face = mesh->mFaces[i];
+            const aiFace &face = mesh->mFaces[i];
 
-            // Retrieve all indices of the face and store them in the indices vector
-            for(unsigned int j = 0; j < face.mNumIndices; ++j)
-                indices.push_back(face.mIndices[j]);
+            // Skip the odd point / line primitive, Triangulate leaves those untouched
+            if(face.mNumIndices != 3)
+                continue;
+
+            // Retrieve all indices of the face and store them in the indices array
+            for(unsigned int j = 0; j < 3; ++j)
+                indices[indexCount++] = face.mIndices[j];
         }
 
+        // Weld, reorder for the vertex cache / overdraw / vertex fetch
+        unsigned int vertexCount = mesh->mNumVertices;
+        MeshOptimizationStats stats = optimizeMesh(vertices, bones, vertexCount, indices, indexCount, scratch);
+        std::cout << "MESH::OPTIMIZE:: " << directory << "/" << mesh->mName.C_Str() << ": vertices " << stats.verticesBefore
+                  << " -> " << stats.verticesAfter << ", ACMR " << stats.acmrBefore << " -> " << stats.acmrAfter << std::endl;
+
         // -----------------
         // Process materials
         // -----------------
-        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+        if(Layout::TEXTURED)
+            loadMeshTextures(scene->mMaterials[mesh->mMaterialIndex], textures);
+
+        // Build the mesh object in place from the extracted mesh data
+        MeshData data;
+        data.vertices = vertices;
+        data.vertexCount = vertexCount;
+        data.indices = indices;
+        data.indexCount = indexCount;
+        data.bones = bones;
+        data.lods = nullptr;
+        data.lodCount = 0;
+        data.meshlets = nullptr;
+        data.meshletCount = 0;
+        if(splitLargeMeshes && data.vertexCount > MAX_16BIT_INDEXED_VERTICES)
+            splitMesh(data, std::move(textures), scratch);
+        else
+            addMesh(data, std::move(textures), scratch);
+    }
+
+    // Clusters large static meshes into meshlets, builds the LOD chain and adds the mesh to the model
+    void addMesh(const MeshData &data, std::vector<Texture> &&textures, ScratchArena &scratch)
+    {
+        MeshData clustered = data;
+        if(data.bones == nullptr && data.indexCount >= MESHLET_MIN_MESH_TRIANGLES * 3)
+            clustered = clusterMeshlets(data, scratch);
+
+        MeshLod lods[MAX_MESH_LODS];
+        MeshData withLods = generateLods(clustered, lods, scratch);
+        if(data.bones != nullptr)
+            skinnedMeshes.emplace_back(withLods, std::move(textures), residency);
+        else
+            meshes.emplace_back(withLods, std::move(textures), residency);
+    }
+
+    // Reorders the triangles into meshlets (LODs are simplified afterwards, so they don't depend on the order)
+    MeshData clusterMeshlets(const MeshData &data, ScratchArena &scratch)
+    {
+        unsigned int* indices = scratch.allocate<unsigned int>(data.indexCount);
+        Meshlet* meshlets = scratch.allocate<Meshlet>(data.indexCount / 3);
+
+        MeshData result = data;
+        result.meshletCount = buildMeshlets(meshlets, indices, data.indices, data.indexCount, data.vertices, data.vertexCount, scratch);
+        result.meshlets = meshlets;
+        result.indices = indices;
+        return result;
+    }
+
+    // Appends simplified LODs after the full detail indices, each aiming for half the triangles of the one
+    // before. All of them are simplified from LOD 0, so their errors are measured against the real surface.
+    MeshData generateLods(const MeshData &data, MeshLod* lods, ScratchArena &scratch)
+    {
+        // Every LOD has at most 3/4 of the previous one's indices, so this always fits
+        unsigned int* indices = scratch.allocate<unsigned int>(data.indexCount * MAX_MESH_LODS);
+        std::memcpy(indices, data.indices, data.indexCount * sizeof(unsigned int));
+        lods[0].firstIndex = 0;
+        lods[0].indexCount = data.indexCount;
+        lods[0].error = 0.0f;
+
+        unsigned int lodCount = 1;
+        unsigned int used = data.indexCount;
+        while(lodCount < MAX_MESH_LODS)
+        {
+            unsigned int target = lods[lodCount - 1].indexCount / 6 * 3;
+            if(target < MIN_LOD_TRIANGLES * 3)
+                break;
+
+            float error;
+            unsigned int count = simplifyMesh(indices + used, data.indices, data.indexCount, data.vertices, data.vertexCount,
+                                              target, FLT_MAX, error, scratch);
+
+            // Stop once the simplifier stalls (locked seams / borders), more LODs wouldn't be any cheaper
+            if(count > lods[lodCount - 1].indexCount * 3 / 4)
+                break;
+
+            optimizeVertexCache(indices + used, count, data.vertexCount, scratch);
+            lods[lodCount].firstIndex = used;
+            lods[lodCount].indexCount = count;
+            lods[lodCount].error = std::max(error, lods[lodCount - 1].error);
+            used += count;
+            ++lodCount;
+        }
+
+        MeshData result = data;
+        result.indices = indices;
+        result.indexCount = used;
+        result.lods = lods;
+        result.lodCount = lodCount;
+        return result;
+    }
+
+    // Splits a mesh into parts of at most MAX_16BIT_INDEXED_VERTICES vertices, so each part gets 16-bit indices.
+    // Triangles keep their order; vertices shared by triangles in different parts are duplicated.
+    void splitMesh(const MeshData &data, std::vector<Texture> &&textures, ScratchArena &scratch)
+    {
+        const unsigned int unassigned = ~0u;
+
+        // Position of each source vertex in the current part
+        unsigned int* remap = scratch.allocate<unsigned int>(data.vertexCount);
+        for(unsigned int i = 0; i < data.vertexCount; ++i)
+            remap[i] = unassigned;
+
+        Vertex* partVertices = scratch.allocate<Vertex>(MAX_16BIT_INDEXED_VERTICES);
+        VertexBoneData* partBones = data.bones != nullptr ? scratch.allocate<VertexBoneData>(MAX_16BIT_INDEXED_VERTICES) : nullptr;
+        unsigned int* partSources = scratch.allocate<unsigned int>(MAX_16BIT_INDEXED_VERTICES);
+        unsigned int* partIndices = scratch.allocate<unsigned int>(data.indexCount);
+
+        MeshData part;
+        part.vertices = partVertices;
+        part.vertexCount = 0;
+        part.indices = partIndices;
+        part.indexCount = 0;
+        part.bones = partBones;
+        part.lods = nullptr;
+        part.lodCount = 0;
+        part.meshlets = nullptr;
+        part.meshletCount = 0;
+
+        for(unsigned int t = 0; t + 2 < data.indexCount; t += 3)
+        {
+            // Close the part when this triangle's new vertices wouldn't fit
+            unsigned int newVertices = 0;
+            for(unsigned int j = 0; j < 3; ++j)
+            {
+                if(remap[data.indices[t + j]] == unassigned)
+                    ++newVertices;
+            }
+            if(part.vertexCount + newVertices > MAX_16BIT_INDEXED_VERTICES)
+            {
+                addMesh(part, std::vector<Texture>(textures), scratch);
+                for(unsigned int i = 0; i < part.vertexCount; ++i)
+                    remap[partSources[i]] = unassigned;
+                part.vertexCount = 0;
+                part.indexCount = 0;
+            }
+
+            for(unsigned int j = 0; j < 3; ++j)
+            {
+                unsigned int index = data.indices[t + j];
+                if(remap[index] == unassigned)
+                {
+                    remap[index] = part.vertexCount;
+                    partSources[part.vertexCount] = index;
+                    partVertices[part.vertexCount] = data.vertices[index];
+                    if(partBones != nullptr)
+                        partBones[part.vertexCount] = data.bones[index];
+                    ++part.vertexCount;
+                }
+                partIndices[part.indexCount++] = remap[index];
+            }
+        }
 
+        if(part.indexCount > 0)
+            addMesh(part, std::move(textures), scratch);
+    }
+
+    // Loads the textures of a mesh's material
+    void loadMeshTextures(aiMaterial* material, std::vector<Texture> &textures)
+    {
         // We assume a convention for sampler names in the shader. Each diffuse texture should be named
         // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER.
         // Same applies to other texture as the following list summarizes:
@@ -173,35 +445,63 @@ private:
         // specular: texture_specularN
         // normal: texture_normalN
 
+        textures.reserve(material->GetTextureCount(aiTextureType_DIFFUSE) + material->GetTextureCount(aiTextureType_SPECULAR) +
+                         material->GetTextureCount(aiTextureType_HEIGHT) + material->GetTextureCount(aiTextureType_AMBIENT));
+
         // 1. Diffuse maps
         // ---------------
-        std::vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+        loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", textures);
 
         // 2. Specular maps
         // ----------------
-        std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", textures);
 
         // 3. Normal maps
         // --------------
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+        loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", textures);
 
         // 4. Height maps
         // --------------
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+        loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", textures);
+    }
 
-        // Returns a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+    // Gathers the bone influences of every vertex, keeping the first MAX_BONE_INFLUENCE of each
+    VertexBoneData* loadBoneWeights(const aiMesh* mesh, ScratchArena &scratch)
+    {
+        VertexBoneData* bones = scratch.allocate<VertexBoneData>(mesh->mNumVertices);
+        for(unsigned int i = 0; i < mesh->mNumVertices; ++i)
+        {
+            for(int j = 0; j < MAX_BONE_INFLUENCE; ++j)
+            {
+                bones[i].m_BoneIDs[j] = -1;
+                bones[i].m_Weights[j] = 0.0f;
+            }
+        }
+
+        for(unsigned int b = 0; b < mesh->mNumBones; ++b)
+        {
+            const aiBone* bone = mesh->mBones[b];
+            for(unsigned int w = 0; w < bone->mNumWeights; ++w)
+            {
+                VertexBoneData &data = bones[bone->mWeights[w].mVertexId];
+                for(int j = 0; j < MAX_BONE_INFLUENCE; ++j)
+                {
+                    if(data.m_BoneIDs[j] < 0)
+                    {
+                        data.m_BoneIDs[j] = static_cast<int>(b);
+                        data.m_Weights[j] = bone->mWeights[w].mWeight;
+                        break;
+                    }
+                }
+            }
+        }
+        return bones;
     }
 
     // Checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // The required info is returned as a Texture struct.
-    std::vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName)
+    // The required info is appended to textures as Texture structs.
+    void loadMaterialTextures(aiMaterial *mat, aiTextureType type, const char* typeName, std::vector<Texture> &textures)
     {
-        std::vector<Texture> textures;
         for(unsigned int i = 0; i < mat->GetTextureCount(type); ++i)
         {
             aiString str;
@@ -230,7 +530,6 @@ private:
                                                         // to ensure we won't unnecessarily load duplicate textures
             }
         }
-        return textures;
     }
 };
 
@@ -263,6 +562,11 @@ unsigned int TextureFromFile(const char* path, const std::string &directory, boo
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+        // Drivers pad RGB8 textures to 4 bytes per texel
+        int bytesPerPixel = nrComponents == 3 ? 4 : nrComponents;
+        ResourceRegistry::record(ResourceRegistry::currentOwner(), RESOURCE_TEXTURE,
+                                 ResourceRegistry::textureBytes(width, height, bytesPerPixel, true));
+
         stbi_image_free(data);
     }
     else
@@ -273,4 +577,7 @@ unsigned int TextureFromFile(const char* path, const std::string &directory, boo
     return textureID;
 }
 
+// Lit models
+typedef BasicModel<StaticLayout> Model;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,95 @@
+#ifndef OBJECT_CONSTANTS_H
+#define OBJECT_CONSTANTS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+// Per-object constants of the model shaders: the model matrix and its normal matrix, the inverse worked out
+// once per object on the CPU instead of for every vertex. Each object gets a slot of a uniform buffer that is
+// refilled every frame, and the shaders' "Object" block reads whichever slot is bound. Like the profiler it's
+// one shared state, so every pass and shader draws with the object last set.
+// -------------------------------------------------------------------------------------------------------------
+class ObjectConstants
+{
+public:
+    // Uniform buffer binding point of the "Object" block (see Shader::setUniformBlockBinding)
+    static const unsigned int BINDING = 1;
+
+    // Makes the buffer, with room for capacity objects a frame. Past that the slots are reused, which is still
+    // correct, but the driver has to wait for or copy what the GPU hasn't read yet.
+    static void init(unsigned int capacity)
+    {
+        State &s = state();
+        int alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        s.stride = static_cast<unsigned int>((sizeof(Block) + alignment - 1) / alignment * alignment);
+        s.capacity = capacity;
+
+        glGenBuffers(1, &s.buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, s.buffer);
+        glBufferData(GL_UNIFORM_BUFFER, s.stride * s.capacity, NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        s.next = 0;
+        s.bound = false;
+    }
+
+    // Starts over at the first slot, on fresh storage so the GPU can go on reading last frame's
+    static void beginFrame()
+    {
+        State &s = state();
+        glBindBuffer(GL_UNIFORM_BUFFER, s.buffer);
+        glBufferData(GL_UNIFORM_BUFFER, s.stride * s.capacity, NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        s.next = 0;
+        s.bound = false;
+    }
+
+    // The object the following draws use. Setting the same model again costs nothing.
+    static void set(const glm::mat4 &model)
+    {
+        State &s = state();
+        if(s.bound && s.model == model)
+            return;
+
+        Block block;
+        block.model = model;
+        block.normalMatrix = glm::mat4(glm::transpose(glm::inverse(glm::mat3(model))));
+
+        if(s.next == s.capacity)
+            s.next = 0;
+        GLintptr offset = static_cast<GLintptr>(s.next++) * s.stride;
+        glBindBuffer(GL_UNIFORM_BUFFER, s.buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, offset, sizeof(Block), &block);
+        glBindBufferRange(GL_UNIFORM_BUFFER, BINDING, s.buffer, offset, sizeof(Block));
+
+        s.model = model;
+        s.bound = true;
+    }
+
+private:
+    // std140 layout of the "Object" block, the normal matrix is the upper left mat3
+    struct Block
+    {
+        glm::mat4 model;
+        glm::mat4 normalMatrix;
+    };
+
+    struct State
+    {
+        unsigned int buffer = 0;
+        unsigned int stride = 0;        // Block size rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+        unsigned int capacity = 0;
+        unsigned int next = 0;          // Slot the next new object goes in
+        bool bound = false;
+        glm::mat4 model;                // Of the bound slot
+    };
+
+    static State &state()
+    {
+        static State s;
+        return s;
+    }
+};
+
+#endif
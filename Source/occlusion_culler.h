@@ -0,0 +1,280 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "vertex_format.h"
+#include "resource_registry.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// Hierarchical-Z occlusion culling. The big static occluders are drawn depth-only into a small depth buffer at
+// the start of every frame and read back through a pixel buffer, so the copy is only mapped a frame later when
+// the GPU is long done with it. The CPU builds a max-depth pyramid from it, and bounding boxes are tested
+// against the pyramid level where they cover at most 2x2 texels: a box is hidden when its nearest point lies
+// behind the farthest occluder depth under it. Tests use the view-projection the depth was rendered with, so
+// the one frame of latency only shows for moving occluders (the occluders here are static).
+// -------------------------------------------------------------------------------------------------------------
+class OcclusionCuller
+{
+public:
+    OcclusionCuller(unsigned int width, unsigned int height)
+        : width(width), height(height), framebuffer(0), depthTexture(0), pixelBuffer(0), pyramidBuffer(0), pending(false),
+          valid(false), viewProjection(1.0f), pendingViewProjection(1.0f), pyramidVersion(0), uploadedVersion(0),
+          levelsProgram(0)
+    {
+    }
+
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+    // Creates the depth target and read-back buffer and sizes the pyramid
+    void setup()
+    {
+        ScopedResourceOwner owner(ResourceRegistry::owner("occlusion_culler"));
+
+        glGenTextures(1, &depthTexture);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        ResourceRegistry::record(ResourceRegistry::currentOwner(), RESOURCE_FRAMEBUFFER, (long long)width * height * sizeof(float));
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::OCCLUSION_CULLER:: Framebuffer is not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        glGenBuffers(1, &pixelBuffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, width * height * sizeof(float), NULL, GL_STREAM_READ);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        // Level sizes and offsets of the pyramid, all levels in one array
+        unsigned int levelWidth = width, levelHeight = height, total = 0;
+        while(true)
+        {
+            Level level = { total, levelWidth, levelHeight };
+            levels.push_back(level);
+            total += levelWidth * levelHeight;
+            if(levelWidth == 1 && levelHeight == 1)
+                break;
+            levelWidth = std::max(1u, (levelWidth + 1) / 2);
+            levelHeight = std::max(1u, (levelHeight + 1) / 2);
+        }
+        pyramid.resize(total);
+    }
+
+    // Picks up last frame's depth, then binds the occluder target. Draw the occluders depth-only until endOccluders.
+    void beginOccluders(const glm::mat4 &occluderViewProjection)
+    {
+        readBack();
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, width, height);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        pendingViewProjection = occluderViewProjection;
+    }
+
+    // Starts the asynchronous copy of the occluder depth and restores the default framebuffer and viewport
+    void endOccluders(int viewportWidth, int viewportHeight)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffer);
+        glReadPixels(0, 0, width, height, GL_DEPTH_COMPONENT, GL_FLOAT, (void*)0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        pending = true;
+
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, viewportWidth, viewportHeight);
+    }
+
+    // Takes depth rendered elsewhere (e.g. by the SoftwareRasterizer) instead of the GPU occluder pass. depth is
+    // window space, width * height floats with row 0 at the bottom.
+    void setDepth(const float* depth, const glm::mat4 &depthViewProjection)
+    {
+        std::memcpy(pyramid.data(), depth, width * height * sizeof(float));
+        viewProjection = depthViewProjection;
+        valid = true;
+        buildPyramid();
+    }
+
+    // Hands the pyramid to a culling compute shader (see shaders/compute/static_batch_cull.cs): uploads it to a
+    // shader storage buffer at binding, once per new pyramid, and sets the occlusion uniforms. Needs GL 4.3.
+    void bindPyramid(const Shader &shader, unsigned int binding) const
+    {
+        shader.setBool("occlusion", valid);
+        if(!valid)
+            return;
+
+        if(pyramidBuffer == 0)
+        {
+            glGenBuffers(1, &pyramidBuffer);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, pyramidBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, pyramid.size() * sizeof(float), NULL, GL_STREAM_DRAW);
+            ResourceRegistry::record(ResourceRegistry::owner("occlusion_culler"), RESOURCE_STORAGE_BUFFER, pyramid.size() * sizeof(float));
+        }
+        if(uploadedVersion != pyramidVersion)
+        {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, pyramidBuffer);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, pyramid.size() * sizeof(float), pyramid.data());
+            uploadedVersion = pyramidVersion;
+        }
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, pyramidBuffer);
+
+        shader.setMat4("occlusionViewProjection", viewProjection);
+        shader.setVec2("occlusionSize", float(width), float(height));
+
+        // The levels don't change after setup, so each program only gets them once. Level is three unsigned ints,
+        // the layout of a uvec3 array.
+        if(levelsProgram != shader.ID)
+        {
+            int levelCount = static_cast<int>(std::min(levels.size(), static_cast<std::size_t>(MAX_GPU_LEVELS)));
+            shader.setUvec3Array("occlusionLevels", &levels[0].offset, levelCount);
+            shader.setInt("occlusionLevelCount", levelCount);
+            levelsProgram = shader.ID;
+        }
+    }
+
+    // Whether any of the model space box under the model matrix may be visible past the occluders. Boxes crossing
+    // the near plane, and everything before the first read-back, count as visible.
+    bool visible(const MeshBounds &bounds, const glm::mat4 &model) const
+    {
+        if(!valid)
+            return true;
+
+        // Screen rectangle and nearest depth of the box
+        glm::mat4 mvp = viewProjection * model;
+        glm::vec2 rectMin(FLT_MAX), rectMax(-FLT_MAX);
+        float nearest = 1.0f;
+        for(int i = 0; i < 8; ++i)
+        {
+            glm::vec3 corner((i & 1) ? bounds.max.x : bounds.min.x, (i & 2) ? bounds.max.y : bounds.min.y,
+                             (i & 4) ? bounds.max.z : bounds.min.z);
+            glm::vec4 clip = mvp * glm::vec4(corner, 1.0f);
+            if(clip.w <= 1e-5f)
+                return true;
+
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            rectMin = glm::min(rectMin, glm::vec2(ndc));
+            rectMax = glm::max(rectMax, glm::vec2(ndc));
+            nearest = std::min(nearest, ndc.z);
+        }
+
+        // Off screen boxes are the frustum culling's business
+        if(rectMax.x < -1.0f || rectMax.y < -1.0f || rectMin.x > 1.0f || rectMin.y > 1.0f)
+            return true;
+
+        // Level 0 texel rectangle, then the level where it spans at most 2x2 texels
+        float x0 = (std::max(rectMin.x, -1.0f) * 0.5f + 0.5f) * width;
+        float y0 = (std::max(rectMin.y, -1.0f) * 0.5f + 0.5f) * height;
+        float x1 = (std::min(rectMax.x, 1.0f) * 0.5f + 0.5f) * width;
+        float y1 = (std::min(rectMax.y, 1.0f) * 0.5f + 0.5f) * height;
+        float size = std::max(x1 - x0, y1 - y0);
+        unsigned int levelIndex = size > 1.0f ? static_cast<unsigned int>(std::ceil(std::log2(size))) : 0;
+        levelIndex = std::min(levelIndex, static_cast<unsigned int>(levels.size() - 1));
+
+        const Level &level = levels[levelIndex];
+        float scale = 1.0f / float(1u << levelIndex);
+        unsigned int tx0 = std::min(static_cast<unsigned int>(x0 * scale), level.width - 1);
+        unsigned int ty0 = std::min(static_cast<unsigned int>(y0 * scale), level.height - 1);
+        unsigned int tx1 = std::min(static_cast<unsigned int>(x1 * scale), level.width - 1);
+        unsigned int ty1 = std::min(static_cast<unsigned int>(y1 * scale), level.height - 1);
+
+        float farthest = 0.0f;
+        for(unsigned int y = ty0; y <= ty1; ++y)
+        {
+            for(unsigned int x = tx0; x <= tx1; ++x)
+                farthest = std::max(farthest, pyramid[level.offset + y * level.width + x]);
+        }
+
+        // Window depth of the nearest point
+        return nearest * 0.5f + 0.5f <= farthest;
+    }
+
+private:
+    static const std::size_t MAX_GPU_LEVELS = 24;     // Size of occlusionLevels in the culling shader
+
+    struct Level
+    {
+        unsigned int offset;
+        unsigned int width;
+        unsigned int height;
+    };
+
+    unsigned int width, height;
+    unsigned int framebuffer, depthTexture, pixelBuffer;
+    mutable unsigned int pyramidBuffer;     // Shader storage copy for GPU culling, created on first use
+    bool pending;               // A read-back was started and not yet picked up
+    bool valid;                 // The pyramid holds occluder depth
+    glm::mat4 viewProjection;           // Of the depth in the pyramid
+    glm::mat4 pendingViewProjection;    // Of the depth being read back
+    std::vector<Level> levels;
+    std::vector<float> pyramid;         // Every level, sized once in setup
+    unsigned int pyramidVersion;        // Bumped on every rebuild, so the GPU copy is only uploaded when stale
+    mutable unsigned int uploadedVersion;
+    mutable unsigned int levelsProgram;     // Last program given the levels
+
+    // Copies the previous frame's depth into level 0 and rebuilds the levels above it
+    void readBack()
+    {
+        if(!pending)
+            return;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffer);
+        const float* depth = static_cast<const float*>(glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY));
+        if(depth != NULL)
+        {
+            std::memcpy(pyramid.data(), depth, width * height * sizeof(float));
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            viewProjection = pendingViewProjection;
+            valid = true;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        pending = false;
+        buildPyramid();
+    }
+
+    // Rebuilds the levels above level 0
+    void buildPyramid()
+    {
+        ++pyramidVersion;
+
+        // Each texel keeps the farthest depth of the (up to) 2x2 texels below it
+        for(unsigned int i = 1; i < levels.size(); ++i)
+        {
+            const Level &source = levels[i - 1];
+            const Level &target = levels[i];
+            for(unsigned int y = 0; y < target.height; ++y)
+            {
+                unsigned int sy0 = std::min(y * 2, source.height - 1);
+                unsigned int sy1 = std::min(y * 2 + 1, source.height - 1);
+                for(unsigned int x = 0; x < target.width; ++x)
+                {
+                    unsigned int sx0 = std::min(x * 2, source.width - 1);
+                    unsigned int sx1 = std::min(x * 2 + 1, source.width - 1);
+                    const float* s = &pyramid[source.offset];
+                    pyramid[target.offset + y * target.width + x] =
+                        std::max(std::max(s[sy0 * source.width + sx0], s[sy0 * source.width + sx1]),
+                                 std::max(s[sy1 * source.width + sx0], s[sy1 * source.width + sx1]));
+                }
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef OPAQUE_QUEUE_H
+#define OPAQUE_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "model.h"
+#include "shader.h"
+#include "object_constants.h"
+#include "impostor.h"
+#include "static_batch.h"
+#include "occlusion_culler.h"
+
+#include <algorithm>
+#include <vector>
+
+// Opaque draws of a pass that share one shader state, collected first and issued together. Without a depth
+// pre-pass they go nearest first, so early depth testing rejects the fragments of what later draws hide instead
+// of shading them. With one, the static batches already have their depth in the buffer and are shaded with
+// GL_EQUAL depth testing, and the order is left alone.
+// -------------------------------------------------------------------------------------------------------------
+class OpaqueQueue
+{
+public:
+    OpaqueQueue()
+    {
+        items.reserve(16);
+    }
+
+    void clear()
+    {
+        items.clear();
+    }
+
+    // A model under the given model matrix, skipped when the occlusion culler finds it hidden and handed to the
+    // impostor, if any, when far away
+    void add(Model &model, const glm::mat4 &transform, Impostor* impostor, const glm::vec3 &cameraPosition)
+    {
+        Item item;
+        item.model = &model;
+        item.batch = nullptr;
+        item.transform = transform;
+        item.impostor = impostor;
+        item.distance = glm::length(glm::vec3(transform * glm::vec4(model.bounds.center(), 1.0f)) - cameraPosition);
+        items.push_back(item);
+    }
+
+    // A static batch, keyed by the distance to its bounds (zero from inside)
+    void add(StaticBatch &batch, const glm::vec3 &cameraPosition)
+    {
+        Item item;
+        item.model = nullptr;
+        item.batch = &batch;
+        item.transform = glm::mat4(1.0f);
+        item.impostor = nullptr;
+        item.distance = glm::length(glm::max(glm::max(batch.bounds.min - cameraPosition, cameraPosition - batch.bounds.max), glm::vec3(0.0f)));
+        items.push_back(item);
+    }
+
+    void draw(Shader &shader, const LodSelection &selection, const MeshletCulling &culling, const OcclusionCuller &occlusion,
+              float impostorDistance, bool depthPrepass)
+    {
+        if(!depthPrepass)
+            std::sort(items.begin(), items.end());
+
+        for(unsigned int i = 0; i < items.size(); ++i)
+        {
+            const Item &item = items[i];
+            if(item.batch != nullptr)
+            {
+                if(depthPrepass)
+                {
+                    glDepthFunc(GL_EQUAL);
+                    glDepthMask(GL_FALSE);
+                }
+                item.batch->Draw(shader, culling, &occlusion);
+                if(depthPrepass)
+                {
+                    glDepthFunc(GL_LESS);
+                    glDepthMask(GL_TRUE);
+                }
+                continue;
+            }
+
+            if(!occlusion.visible(item.model->bounds, item.transform))
+                continue;
+            if(item.impostor != nullptr && item.impostor->addIfDistant(item.transform, culling.cameraPosition, impostorDistance))
+                continue;
+
+            ObjectConstants::set(item.transform);
+            item.model->Draw(shader, item.transform, selection);
+        }
+    }
+
+private:
+    struct Item
+    {
+        float distance;             // From the camera
+        Model* model;               // Either a model
+        StaticBatch* batch;         // or a static batch
+        glm::mat4 transform;
+        Impostor* impostor;
+
+        bool operator<(const Item &other) const { return distance < other.distance; }
+    };
+
+    std::vector<Item> items;
+};
+
+#endif
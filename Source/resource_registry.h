@@ -0,0 +1,217 @@
+#ifndef RESOURCE_REGISTRY_H
+#define RESOURCE_REGISTRY_H
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// What a block of memory is used for
+enum ResourceCategory
+{
+    RESOURCE_VERTEX_BUFFER,     // GPU vertex buffers
+    RESOURCE_INDEX_BUFFER,      // GPU index buffers
+    RESOURCE_STORAGE_BUFFER,    // GPU shader storage and indirect command buffers (GPU culling)
+    RESOURCE_TEXTURE,           // GPU 2D textures (including their mip chain)
+    RESOURCE_CUBEMAP,           // GPU cubemap textures
+    RESOURCE_FRAMEBUFFER,       // GPU framebuffer attachments
+    RESOURCE_MESH_DATA,         // CPU copies of vertices / indices kept alive after upload
+    RESOURCE_CATEGORY_COUNT
+};
+
+enum MemoryDomain
+{
+    MEMORY_CPU,
+    MEMORY_GPU
+};
+
+// Keeps a running tally of the bytes every asset allocates, tagged by owning asset and category.
+// Loaders record against the current owner, which Model sets for the duration of its import.
+// ---------------------------------------------------------------------------------------------
+class ResourceRegistry
+{
+public:
+    // Returns the id of the named owner, creating it on first use
+    static int owner(const std::string &name)
+    {
+        std::vector<Owner> &owners = state().owners;
+        for(unsigned int i = 0; i < owners.size(); ++i)
+        {
+            if(owners[i].name == name)
+                return i;
+        }
+        owners.push_back(Owner(name));
+        return static_cast<int>(owners.size() - 1);
+    }
+
+    // The owner loaders record against when they aren't told otherwise
+    static int currentOwner()
+    {
+        return state().currentOwner;
+    }
+
+    static void setCurrentOwner(int ownerId)
+    {
+        state().currentOwner = ownerId;
+    }
+
+    // Adds (or with a negative size, removes) bytes to an owner's category
+    static void record(int ownerId, ResourceCategory category, long long bytes)
+    {
+        state().owners[ownerId].bytes[category] += bytes;
+    }
+
+    static void release(int ownerId, ResourceCategory category, long long bytes)
+    {
+        record(ownerId, category, -bytes);
+    }
+
+    static MemoryDomain domainOf(ResourceCategory category)
+    {
+        return category == RESOURCE_MESH_DATA ? MEMORY_CPU : MEMORY_GPU;
+    }
+
+    static long long totalBytes(MemoryDomain domain)
+    {
+        long long total = 0;
+        const std::vector<Owner> &owners = state().owners;
+        for(unsigned int i = 0; i < owners.size(); ++i)
+            total += owners[i].total(domain);
+        return total;
+    }
+
+    // Reports
+    // -------
+    static void printReport()
+    {
+        const std::vector<Owner> &owners = state().owners;
+
+        std::printf("%-40s", "owner");
+        for(int c = 0; c < RESOURCE_CATEGORY_COUNT; ++c)
+            std::printf(" %14s", categoryName(static_cast<ResourceCategory>(c)));
+        std::printf(" %10s %10s\n", "cpu KB", "gpu KB");
+
+        for(unsigned int i = 0; i < owners.size(); ++i)
+        {
+            std::printf("%-40.40s", owners[i].name.c_str());
+            for(int c = 0; c < RESOURCE_CATEGORY_COUNT; ++c)
+                std::printf(" %14lld", owners[i].bytes[c]);
+            std::printf(" %10.1f %10.1f\n", owners[i].total(MEMORY_CPU) / 1024.0, owners[i].total(MEMORY_GPU) / 1024.0);
+        }
+        std::printf("%-40s cpu %.2f MB, gpu %.2f MB\n", "total", totalBytes(MEMORY_CPU) / (1024.0 * 1024.0),
+                    totalBytes(MEMORY_GPU) / (1024.0 * 1024.0));
+        std::cout << std::flush;
+    }
+
+    static bool writeJson(const char* path)
+    {
+        std::ofstream file(path);
+        if(!file)
+        {
+            std::cout << "ERROR::RESOURCE_REGISTRY:: Could not write report to " << path << std::endl;
+            return false;
+        }
+
+        const std::vector<Owner> &owners = state().owners;
+        file << "{\n  \"owners\": [\n";
+        for(unsigned int i = 0; i < owners.size(); ++i)
+        {
+            file << "    { \"name\": \"" << escape(owners[i].name) << "\"";
+            for(int c = 0; c < RESOURCE_CATEGORY_COUNT; ++c)
+                file << ", \"" << categoryName(static_cast<ResourceCategory>(c)) << "\": " << owners[i].bytes[c];
+            file << ", \"cpu\": " << owners[i].total(MEMORY_CPU) << ", \"gpu\": " << owners[i].total(MEMORY_GPU) << " }";
+            file << (i + 1 < owners.size() ? ",\n" : "\n");
+        }
+        file << "  ],\n  \"total\": { \"cpu\": " << totalBytes(MEMORY_CPU) << ", \"gpu\": " << totalBytes(MEMORY_GPU) << " }\n}\n";
+        return true;
+    }
+
+    static const char* categoryName(ResourceCategory category)
+    {
+        static const char* names[RESOURCE_CATEGORY_COUNT] =
+        {
+            "vertex_buffer", "index_buffer", "storage_buffer", "texture", "cubemap", "framebuffer", "mesh_data"
+        };
+        return names[category];
+    }
+
+    // Size estimates for GL allocations
+    // ---------------------------------
+
+    // A mipmapped texture costs about 4/3 of its base level
+    static long long textureBytes(int width, int height, int bytesPerPixel, bool mipmapped)
+    {
+        long long base = static_cast<long long>(width) * height * bytesPerPixel;
+        return mipmapped ? base * 4 / 3 : base;
+    }
+
+private:
+    struct Owner
+    {
+        std::string name;
+        long long bytes[RESOURCE_CATEGORY_COUNT];
+
+        Owner(const std::string &name) : name(name), bytes() {}
+
+        long long total(MemoryDomain domain) const
+        {
+            long long sum = 0;
+            for(int c = 0; c < RESOURCE_CATEGORY_COUNT; ++c)
+            {
+                if(domainOf(static_cast<ResourceCategory>(c)) == domain)
+                    sum += bytes[c];
+            }
+            return sum;
+        }
+    };
+
+    struct State
+    {
+        std::vector<Owner> owners;
+        int currentOwner;
+
+        State() : currentOwner(0)
+        {
+            owners.push_back(Owner("scene"));     // Catch-all for anything recorded outside a model
+        }
+    };
+
+    static State &state()
+    {
+        static State s;
+        return s;
+    }
+
+    static std::string escape(const std::string &text)
+    {
+        std::string result;
+        for(unsigned int i = 0; i < text.size(); ++i)
+        {
+            if(text[i] == '"' || text[i] == '\\')
+                result += '\\';
+            result += text[i];
+        }
+        return result;
+    }
+};
+
+// Makes an owner current for the lifetime of the object (e.g. while a model is loading)
+class ScopedResourceOwner
+{
+public:
+    ScopedResourceOwner(int ownerId) : previous(ResourceRegistry::currentOwner())
+    {
+        ResourceRegistry::setCurrentOwner(ownerId);
+    }
+
+    ~ScopedResourceOwner()
+    {
+        ResourceRegistry::setCurrentOwner(previous);
+    }
+
+private:
+    int previous;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+// Linear allocator for short-lived import temporaries. Allocation is a pointer bump, nothing is freed
+// individually, and reset() rewinds the whole arena while keeping its largest block for reuse, so
+// importing a model only touches the heap while the arena grows to fit its biggest mesh.
+// --------------------------------------------------------------------------------------------------
+class ScratchArena
+{
+public:
+    ScratchArena(std::size_t initialSize = 1 << 20) : blockSize(initialSize), offset(0) {}
+
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    // Returns uninitialized storage for count objects of T (only meant for trivially copyable types)
+    template<typename T>
+    T* allocate(std::size_t count)
+    {
+        std::size_t alignment = alignof(T);
+        std::size_t size = count * sizeof(T);
+
+        std::size_t start = (offset + alignment - 1) & ~(alignment - 1);
+        if(blocks.empty() || start + size > blockSize)
+        {
+            // Start a new block big enough for this request; older blocks stay valid until reset()
+            if(size > blockSize)
+                blockSize = size;
+            blocks.push_back(std::unique_ptr<char[]>(new char[blockSize]));
+            start = 0;
+        }
+
+        offset = start + size;
+        return reinterpret_cast<T*>(blocks.back().get() + start);
+    }
+
+    // Invalidates everything allocated so far
+    void reset()
+    {
+        if(blocks.size() > 1)
+        {
+            // Keep only the newest (largest) block
+            std::unique_ptr<char[]> largest = std::move(blocks.back());
+            blocks.clear();
+            blocks.push_back(std::move(largest));
+        }
+        offset = 0;
+    }
+
+private:
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::size_t blockSize;
+    std::size_t offset;
+};
+
+#endif
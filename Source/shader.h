@@ -3,10 +3,31 @@
 
 #include <glad/glad.h>
 
+#include "gl_profiler.h"
+
+#include <cstdio>
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// KHR_parallel_shader_compile (same values as the ARB version), which glad was generated without
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
 
 class Shader
 {
@@ -88,6 +109,15 @@ public:
     Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr,
            const char* tessControlPath = nullptr, const char* tessEvalPath = nullptr)
     {
+        sourcePaths.push_back(vertexPath);
+        sourcePaths.push_back(fragmentPath);
+        if(geometryPath != nullptr || tessControlPath != nullptr || tessEvalPath != nullptr)
+        {
+            sourcePaths.push_back(geometryPath != nullptr ? geometryPath : "");
+            sourcePaths.push_back(tessControlPath != nullptr ? tessControlPath : "");
+            sourcePaths.push_back(tessEvalPath != nullptr ? tessEvalPath : "");
+        }
+
         // 1. Retrieve the vertex / fragment source code from filePath
         // -----------------------------------------------------------
         std::string vertexCode;
@@ -162,6 +192,19 @@ public:
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
         }
 
+        // Plain vertex / fragment pairs share their stages with every other pair when separable
+        if(separableStages() && geometryPath == nullptr && tessControlPath == nullptr && tessEvalPath == nullptr)
+        {
+            buildPipeline(vertexCode, fragmentCode, std::string());
+            return;
+        }
+
+        // A cached binary of the same sources on the same driver skips compiling altogether
+        std::string cachePath = programCachePath(vertexCode + '\0' + fragmentCode + '\0' + geometryCode + '\0' +
+                                                 tessControlCode + '\0' + tessEvalCode);
+        if(loadProgramBinary(cachePath))
+            return;
+
         const char* vShaderCode = vertexCode.c_str();
         const char* fShaderCode = fragmentCode.c_str();
 
@@ -174,13 +217,11 @@ public:
         vertex = glCreateShader(GL_VERTEX_SHADER);
         glShaderSource(vertex, 1, &vShaderCode, NULL);
         glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
 
         // Fragment shader
         fragment = glCreateShader(GL_FRAGMENT_SHADER);
         glShaderSource(fragment, 1, &fShaderCode, NULL);
         glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
 
         // If geometry shader is given, compile geometry shader
         unsigned int geometry;
@@ -190,7 +231,6 @@ public:
             geometry = glCreateShader(GL_GEOMETRY_SHADER);
             glShaderSource(geometry, 1, &gShaderCode, NULL);
             glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
         }
 
         // If tessellation control shader is given, compile tessellation control shader
@@ -201,7 +241,6 @@ public:
             tessControl = glCreateShader(GL_TESS_CONTROL_SHADER);
             glShaderSource(tessControl, 1, &tcShaderCode, NULL);
             glCompileShader(tessControl);
-            checkCompileErrors(tessControl, "TESS_CONTROL");
         }
 
         // If tessellation evaluation shader is given, compile tessellation evaluation shader
@@ -212,7 +251,6 @@ public:
             tessEval = glCreateShader(GL_TESS_EVALUATION_SHADER);
             glShaderSource(tessEval, 1, &teShaderCode, NULL);
             glCompileShader(tessEval);
-            checkCompileErrors(tessEval, "TESS_EVALUATION");
         }
 
         // 3. Shader program
@@ -226,76 +264,768 @@ public:
             glAttachShader(ID, tessControl);
         if(tessEvalPath != nullptr)
             glAttachShader(ID, tessEval);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+        linkProgram(cachePath);
 
-        // Delete the shaders as they're linked into our program now and are not longer necessary
+        // Delete the shaders as they're linked into our program now and are not longer necessary (they live on
+        // while attached, for finalize to read their logs)
         glDeleteShader(vertex);
         glDeleteShader(fragment);
         if(geometryPath != nullptr)
             glDeleteShader(geometry);
+        if(tessControlPath != nullptr)
+            glDeleteShader(tessControl);
+        if(tessEvalPath != nullptr)
+            glDeleteShader(tessEval);
+    }
+
+    // Constructor generates a vertex / fragment program with the given #define lines inserted after the #version
+    // line of both (see ShaderVariants)
+    // -------------------------------------------------------------------------------------------------------------
+    Shader(const char* vertexPath, const char* fragmentPath, const std::string &defines)
+    {
+        sourcePaths.push_back(vertexPath);
+        sourcePaths.push_back(fragmentPath);
+        sourceDefines = defines;
+
+        if(separableStages())
+        {
+            buildPipeline(readFile(vertexPath), readFile(fragmentPath), defines);
+            return;
+        }
+
+        std::string vertexCode = injectDefines(readFile(vertexPath), defines);
+        std::string fragmentCode = injectDefines(readFile(fragmentPath), defines);
+        std::string cachePath = programCachePath(vertexCode + '\0' + fragmentCode);
+        if(loadProgramBinary(cachePath))
+            return;
+
+        const char* vShaderCode = vertexCode.c_str();
+        const char* fShaderCode = fragmentCode.c_str();
+
+        unsigned int vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex, 1, &vShaderCode, NULL);
+        glCompileShader(vertex);
+
+        unsigned int fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment, 1, &fShaderCode, NULL);
+        glCompileShader(fragment);
+
+        ID = glCreateProgram();
+        glAttachShader(ID, vertex);
+        glAttachShader(ID, fragment);
+        linkProgram(cachePath);
+
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+    }
+
+    // Constructor generates a compute shader program (needs a GL 4.3 context)
+    // ------------------------------------------------------------------------
+    explicit Shader(const char* computePath)
+    {
+        sourcePaths.push_back(computePath);
+
+        std::string computeCode = readFile(computePath);
+        std::string cachePath = programCachePath(computeCode);
+        if(loadProgramBinary(cachePath))
+            return;
+
+        const char* cShaderCode = computeCode.c_str();
+        unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(compute, 1, &cShaderCode, NULL);
+        glCompileShader(compute);
+
+        ID = glCreateProgram();
+        glAttachShader(ID, compute);
+        linkProgram(cachePath);
+
+        glDeleteShader(compute);
+    }
+
+    // Linked programs are written to this directory as driver specific binaries and loaded from there on later
+    // runs instead of being compiled again. Empty (the default) turns the cache off. Set it before the first
+    // Shader is made.
+    // -------------------------------------------------------------------------------------------------------------
+    static void setCacheDirectory(const std::string &directory)
+    {
+        cacheDirectory() = directory;
+    }
+
+    // Uniform blocks of this name, in every program made from now on, read the given uniform buffer binding
+    // point (GLSL 330 has no layout(binding) for them)
+    // -------------------------------------------------------------------------------------------------------------
+    static void setUniformBlockBinding(const std::string &block, unsigned int binding)
+    {
+        uniformBlockBindings()[block] = binding;
+    }
+
+    // Builds vertex / fragment shaders as program pipelines of separable single stage programs (GL 4.1), which
+    // are compiled once per distinct source and shared. A new combination of stages, or a variant whose defines
+    // one stage doesn't use, then costs no compile or link. Call it once after GLAD is loaded, before the first
+    // Shader is made.
+    // -------------------------------------------------------------------------------------------------------------
+    static void enableSeparableStages()
+    {
+        separableStages() = GLAD_GL_VERSION_4_1 != 0;
+        if(!separableStages())
+            std::cout << "SHADER:: Separable stages need GL 4.1, linking whole programs" << std::endl;
+    }
+
+    // Lets the driver compile and link on threads of its own (KHR / ARB_parallel_shader_compile), so constructing
+    // a Shader only submits the work and the models can load meanwhile. Call it once after GLAD is loaded, with
+    // the same loader.
+    // -------------------------------------------------------------------------------------------------------------
+    static void enableParallelCompile(GLADloadproc load)
+    {
+        int extensionCount = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+        const char* function = NULL;
+        for(int i = 0; i < extensionCount && function == NULL; ++i)
+        {
+            const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+            if(strcmp(extension, "GL_KHR_parallel_shader_compile") == 0)
+                function = "glMaxShaderCompilerThreadsKHR";
+            else if(strcmp(extension, "GL_ARB_parallel_shader_compile") == 0)
+                function = "glMaxShaderCompilerThreadsARB";
+        }
+        if(function == NULL)
+        {
+            std::cout << "SHADER:: No parallel shader compile extension, compiling on the driver's own terms" << std::endl;
+            return;
+        }
 
+        typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+        MaxShaderCompilerThreadsProc maxShaderCompilerThreads = reinterpret_cast<MaxShaderCompilerThreadsProc>(load(function));
+        if(maxShaderCompilerThreads != NULL)
+            maxShaderCompilerThreads(0xFFFFFFFFu);     // As many threads as the driver likes
+        parallelCompile() = true;
     }
 
-    // Use/Activate the shader
-    // -----------------------
+    // Whether the program is done compiling and linking, so finalize won't block. Without the parallel compile
+    // extension there is no asking, and it's always true.
+    bool ready() const
+    {
+        if(linkPending && vertexStage != nullptr)
+            return vertexStage->ready() && fragmentStage->ready();
+        if(!linkPending || !parallelCompile())
+            return true;
+        int done = 0;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+        return done != 0;
+    }
+
+    // Waits for the link, reports the errors of the program and its stages, and writes the program to the cache.
+    // Constructors leave this to the first use(), so a compile never stalls the thread that submitted it.
+    void finalize()
+    {
+        if(!linkPending)
+            return;
+        linkPending = false;
+
+        // A pipeline takes its stages once they're linked (and checked, the first pipeline to get there does it)
+        if(vertexStage != nullptr)
+        {
+            vertexStage->finalize();
+            fragmentStage->finalize();
+            linkFailed = vertexStage->linkFailed || fragmentStage->linkFailed;
+            glUseProgramStages(ID, GL_VERTEX_SHADER_BIT, vertexStage->ID);
+            glUseProgramStages(ID, GL_FRAGMENT_SHADER_BIT, fragmentStage->ID);
+            return;
+        }
+
+        int success = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        if(!success)
+        {
+            unsigned int stages[5];
+            int stageCount = 0;
+            glGetAttachedShaders(ID, 5, &stageCount, stages);
+            for(int i = 0; i < stageCount; ++i)
+                checkCompileErrors(stages[i], stageName(stages[i]));
+            checkCompileErrors(ID, "PROGRAM");
+            linkFailed = true;
+            return;
+        }
+
+        bindUniformBlocks();
+        saveProgramBinary(pendingCachePath);
+        pendingCachePath.clear();
+    }
+
+    // Use/Activate the shader. One that failed to link unbinds the current program instead, its draws are
+    // skipped rather than raising an error each time, and its uniforms are left alone.
+    // -----------------------------------------------------------------------------------------------------
     void use()
     {
-        glUseProgram(ID);
+        if(linkPending)
+            finalize();
+        if(linkFailed)
+        {
+            glUseProgram(0);
+            if(GLAD_GL_VERSION_4_1)
+                glBindProgramPipeline(0);
+            return;
+        }
+        if(vertexStage != nullptr)
+        {
+            glUseProgram(0);        // A current program would override the pipeline
+            glBindProgramPipeline(ID);
+        }
+        else
+            glUseProgram(ID);
+    }
+
+    // Hot Reload
+    // ----------
+    // Whether the file at path (as given to the constructor) is one of the sources
+    bool usesSource(const std::string &path) const
+    {
+        for(unsigned int i = 0; i < sourcePaths.size(); ++i)
+        {
+            if(sourcePaths[i] == path)
+                return true;
+        }
+        return false;
+    }
+
+    // A new Shader from the current contents of the same files, only submitted (see ready). Stages whose source
+    // didn't change come out of the stage and binary caches instead of being compiled again.
+    Shader rebuild() const
+    {
+        if(sourcePaths.size() == 1)
+            return Shader(sourcePaths[0].c_str());
+        if(sourcePaths.size() == 2)
+            return Shader(sourcePaths[0].c_str(), sourcePaths[1].c_str(), sourceDefines);
+        return Shader(sourcePaths[0].c_str(), sourcePaths[1].c_str(), optionalPath(2), optionalPath(3), optionalPath(4));
+    }
+
+    // Switches to the program of fresh, a rebuild of this one, if it linked: the uniform values set so far are
+    // carried over and the old program is deleted. Otherwise fresh is deleted and this one stays as it was.
+    // Copies of the Shader keep the old ID, so take them anew after this.
+    bool replaceWith(Shader &fresh)
+    {
+        fresh.finalize();
+        if(fresh.linkFailed)
+        {
+            fresh.release();
+            return false;
+        }
+
+        fresh.use();
+        if(vertexStage == nullptr)
+            fresh.restoreUniforms(*uniforms);
+        else
+        {
+            fresh.restoreUniforms(*vertexStage->uniforms);
+            fresh.restoreUniforms(*fragmentStage->uniforms);
+        }
+
+        release();
+        *this = fresh;
+        return true;
     }
 
     // Utility uniform functions
     // -------------------------
-    void setBool(const std::string &name, bool value) const
+    // Names are taken as plain C strings so that calls with string literals in the render loop don't
+    // construct a std::string (and hit the heap) on every call. A value equal to the last one uploaded to the
+    // uniform isn't sent again (see updateShadow).
+    void setBool(const char* name, bool value) const
+    {
+        setInt(name, (int)value);
+    }
+    void setInt(const char* name, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        upload(name, GL_INT, &value, sizeof(value), [&](int location) { glUniform1i(location, value); });
     }
-    void setInt(const std::string &name, int value) const
+    void setUint(const char* name, unsigned int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        upload(name, GL_UNSIGNED_INT, &value, sizeof(value), [&](int location) { glUniform1ui(location, value); });
     }
-    void setFloat(const std::string &name, float value) const
+    void setFloat(const char* name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        upload(name, GL_FLOAT, &value, sizeof(value), [&](int location) { glUniform1f(location, value); });
     }
-    void setVec2(const std::string &name, const glm::vec2 &value) const
+    void setVec2(const char* name, const glm::vec2 &value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        upload(name, GL_FLOAT_VEC2, &value[0], sizeof(value), [&](int location) { glUniform2fv(location, 1, &value[0]); });
     }
-    void setVec2(const std::string &name, float x, float y) const
+    void setVec2(const char* name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        setVec2(name, glm::vec2(x, y));
     }
-    void setVec3(const std::string &name, const glm::vec3 &value) const
+    void setVec3(const char* name, const glm::vec3 &value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        upload(name, GL_FLOAT_VEC3, &value[0], sizeof(value), [&](int location) { glUniform3fv(location, 1, &value[0]); });
     }
-    void setVec3(const std::string &name, float x, float y, float z) const
+    void setVec3(const char* name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        setVec3(name, glm::vec3(x, y, z));
     }
-    void setVec4(const std::string &name, const glm::vec4 &value) const
+    void setVec4(const char* name, const glm::vec4 &value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        upload(name, GL_FLOAT_VEC4, &value[0], sizeof(value), [&](int location) { glUniform4fv(location, 1, &value[0]); });
     }
-    void setVec4(const std::string &name, float x, float y, float z, float w)
+    void setVec4(const char* name, float x, float y, float z, float w)
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        setVec4(name, glm::vec4(x, y, z, w));
     }
-    void setMat2(const std::string &name, const glm::mat2 &mat) const
+    void setVec4Array(const char* name, const glm::vec4* values, int count) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        upload(name, GL_FLOAT_VEC4, &values[0][0], count * sizeof(glm::vec4), [&](int location) { glUniform4fv(location, count, &values[0][0]); });
     }
-    void setMat3(const std::string &name, const glm::mat3 &mat) const
+    // Three unsigned ints per element, the layout of a uvec3 array
+    void setUvec3Array(const char* name, const unsigned int* values, int count) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        upload(name, GL_UNSIGNED_INT_VEC3, values, count * 3 * sizeof(unsigned int), [&](int location) { glUniform3uiv(location, count, values); });
     }
-    void setMat4(const std::string &name, const glm::mat4 &mat) const
+    void setMat2(const char* name, const glm::mat2 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        upload(name, GL_FLOAT_MAT2, &mat[0][0], sizeof(mat), [&](int location) { glUniformMatrix2fv(location, 1, GL_FALSE, &mat[0][0]); });
+    }
+    void setMat3(const char* name, const glm::mat3 &mat) const
+    {
+        upload(name, GL_FLOAT_MAT3, &mat[0][0], sizeof(mat), [&](int location) { glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]); });
+    }
+    void setMat4(const char* name, const glm::mat4 &mat) const
+    {
+        upload(name, GL_FLOAT_MAT4, &mat[0][0], sizeof(mat), [&](int location) { glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]); });
     }
 
 private:
+    // Link not checked yet (see finalize), and where the program goes in the cache once it is
+    bool linkPending = false;
+    std::string pendingCachePath;
+
+    bool linkFailed = false;
+
+    // For a pipeline (ID is then the pipeline object), its stage programs, owned by stageProgram
+    Shader* vertexStage = nullptr;
+    Shader* fragmentStage = nullptr;
+
+    // What the Shader was made from, for rebuild: the constructor's paths ("" for a missing optional stage) and
+    // the defines
+    std::vector<std::string> sourcePaths;
+    std::string sourceDefines;
+
+    // Location and last uploaded value of a uniform
+    struct Uniform
+    {
+        std::string name;
+        int location;
+        GLenum type;                    // GL_INT, GL_FLOAT, GL_FLOAT_VEC3, GL_FLOAT_MAT4, ... (of the elements)
+        unsigned int size;              // Of value, 0 before the first upload
+        std::vector<unsigned char> value;       // Whole arrays too, sized by the first upload
+    };
+
+    // The program's uniforms by FNV-1a hash of their name. Uniform values belong to the GL program, so every
+    // copy of the Shader shares this.
+    std::shared_ptr<std::unordered_map<unsigned int, Uniform> > uniforms = std::make_shared<std::unordered_map<unsigned int, Uniform> >();
+
+    // A separable program of a single stage, for pipelines to share
+    Shader(GLenum type, const std::string &code)
+    {
+        std::string cachePath = programCachePath("SEPARABLE " + std::to_string(type) + '\0' + code);
+        if(loadProgramBinary(cachePath, true))
+            return;
+
+        const char* stageCode = code.c_str();
+        unsigned int stage = glCreateShader(type);
+        glShaderSource(stage, 1, &stageCode, NULL);
+        glCompileShader(stage);
+
+        ID = glCreateProgram();
+        glProgramParameteri(ID, GL_PROGRAM_SEPARABLE, GL_TRUE);
+        glAttachShader(ID, stage);
+        linkProgram(cachePath);
+
+        glDeleteShader(stage);
+    }
+
+    // Sets a uniform to value (size bytes) through set(location) in the program, or in each stage of a pipeline
+    // that has it (for glUniform* to reach a stage it has to be the pipeline's active program)
+    template<typename Upload>
+    void upload(const char* name, GLenum type, const void* value, unsigned int size, Upload set) const
+    {
+        int location;
+        if(linkFailed)
+            return;
+        if(vertexStage == nullptr)
+        {
+            if(updateShadow(name, type, value, size, location))
+                set(location);
+            return;
+        }
+
+        const Shader* stages[2] = { vertexStage, fragmentStage };
+        for(unsigned int i = 0; i < 2; ++i)
+        {
+            if(!stages[i]->updateShadow(name, type, value, size, location))
+                continue;
+            glActiveShaderProgram(ID, stages[i]->ID);
+            set(location);
+        }
+    }
+
+    // Finds the uniform (asking GL for the location only the first time) and records value as its last upload.
+    // False when there's nothing to send: the program doesn't have it, or it already holds this exact value.
+    bool updateShadow(const char* name, GLenum type, const void* value, unsigned int size, int &location) const
+    {
+        unsigned int hash = 2166136261u;
+        for(const char* c = name; *c != '\0'; ++c)
+            hash = (hash ^ static_cast<unsigned char>(*c)) * 16777619u;
+
+        std::unordered_map<unsigned int, Uniform>::iterator found = uniforms->find(hash);
+        if(found == uniforms->end())
+        {
+            Uniform uniform;
+            uniform.name = name;
+            uniform.location = glGetUniformLocation(ID, name);
+            uniform.type = GL_NONE;
+            uniform.size = 0;
+            found = uniforms->insert(std::make_pair(hash, uniform)).first;
+        }
+        else if(found->second.name != name)
+        {
+            // Another name with the same hash, this one goes uncached
+            location = glGetUniformLocation(ID, name);
+            return location != -1;
+        }
+
+        Uniform &uniform = found->second;
+        location = uniform.location;
+        if(location == -1)
+            return false;
+        if(uniform.size == size && std::memcmp(uniform.value.data(), value, size) == 0)
+        {
+            GLProfiler::countSkippedUniform();
+            return false;
+        }
+
+        uniform.type = type;
+        uniform.size = size;
+        const unsigned char* bytes = static_cast<const unsigned char*>(value);
+        uniform.value.assign(bytes, bytes + size);
+        return true;
+    }
+
+    // Sets every uniform uploaded to the old program, from its records, on this one (bound)
+    void restoreUniforms(const std::unordered_map<unsigned int, Uniform> &old)
+    {
+        for(std::unordered_map<unsigned int, Uniform>::const_iterator i = old.begin(); i != old.end(); ++i)
+        {
+            const Uniform &uniform = i->second;
+            const char* name = uniform.name.c_str();
+            if(uniform.size == 0)
+                continue;
+
+            switch(uniform.type)
+            {
+            case GL_INT: setInt(name, recorded<int>(uniform)); break;
+            case GL_UNSIGNED_INT: setUint(name, recorded<unsigned int>(uniform)); break;
+            case GL_UNSIGNED_INT_VEC3:
+                setUvec3Array(name, reinterpret_cast<const unsigned int*>(uniform.value.data()), uniform.size / (3 * sizeof(unsigned int)));
+                break;
+            case GL_FLOAT: setFloat(name, recorded<float>(uniform)); break;
+            case GL_FLOAT_VEC2: setVec2(name, recorded<glm::vec2>(uniform)); break;
+            case GL_FLOAT_VEC3: setVec3(name, recorded<glm::vec3>(uniform)); break;
+            case GL_FLOAT_VEC4:
+                setVec4Array(name, reinterpret_cast<const glm::vec4*>(uniform.value.data()), uniform.size / sizeof(glm::vec4));
+                break;
+            case GL_FLOAT_MAT2: setMat2(name, recorded<glm::mat2>(uniform)); break;
+            case GL_FLOAT_MAT3: setMat3(name, recorded<glm::mat3>(uniform)); break;
+            case GL_FLOAT_MAT4: setMat4(name, recorded<glm::mat4>(uniform)); break;
+            }
+        }
+    }
+
+    template<typename T>
+    static T recorded(const Uniform &uniform)
+    {
+        T value;
+        std::memcpy(&value, uniform.value.data(), sizeof(T));
+        return value;
+    }
+
+    const char* optionalPath(unsigned int index) const
+    {
+        return sourcePaths[index].empty() ? nullptr : sourcePaths[index].c_str();
+    }
+
+    // Deletes the program, or the pipeline and the stages no other pipeline uses
+    void release()
+    {
+        if(vertexStage != nullptr)
+        {
+            glDeleteProgramPipelines(1, &ID);
+            releaseStage(vertexStage);
+            releaseStage(fragmentStage);
+        }
+        else
+            glDeleteProgram(ID);
+    }
+
+    // Program Pipelines
+    // -----------------
+    static bool& separableStages()
+    {
+        static bool enabled = false;
+        return enabled;
+    }
+
+    // Each stage only gets the defines it mentions, so e.g. the fragment-only light features of the model shader
+    // don't split its vertex stage
+    void buildPipeline(const std::string &vertexCode, const std::string &fragmentCode, const std::string &defines)
+    {
+        vertexStage = stageProgram(GL_VERTEX_SHADER, injectDefines(vertexCode, usedDefines(vertexCode, defines)));
+        fragmentStage = stageProgram(GL_FRAGMENT_SHADER, injectDefines(fragmentCode, usedDefines(fragmentCode, defines)));
+        glGenProgramPipelines(1, &ID);
+        linkPending = true;     // The stages go in at finalize, once linked
+    }
+
+    // Stage programs by type and source, with the number of pipelines made from each
+    typedef std::map<std::string, std::pair<Shader, unsigned int> > StageMap;
+
+    static StageMap& stages()
+    {
+        static StageMap shared;
+        return shared;
+    }
+
+    // The stage program for this exact source, compiled the first time it's asked for. Every pipeline built on
+    // it holds it until release.
+    static Shader* stageProgram(GLenum type, const std::string &code)
+    {
+        StageMap &shared = stages();
+        std::string key = std::to_string(type) + '\0' + code;
+        StageMap::iterator stage = shared.find(key);
+        if(stage == shared.end())
+            stage = shared.insert(std::make_pair(key, std::make_pair(Shader(type, code), 0u))).first;
+        ++stage->second.second;
+        return &stage->second.first;
+    }
+
+    // Lets go of a pipeline's stage, deleting it with the last pipeline, e.g. the version of a stage file a hot
+    // reload replaced
+    static void releaseStage(const Shader* program)
+    {
+        StageMap &shared = stages();
+        for(StageMap::iterator stage = shared.begin(); stage != shared.end(); ++stage)
+        {
+            if(&stage->second.first != program)
+                continue;
+            if(--stage->second.second == 0)
+            {
+                glDeleteProgram(program->ID);
+                shared.erase(stage);
+            }
+            return;
+        }
+    }
+
+    // The lines of defines whose macro appears anywhere in code
+    static std::string usedDefines(const std::string &code, const std::string &defines)
+    {
+        std::string used;
+        std::istringstream lines(defines);
+        std::string line;
+        while(std::getline(lines, line))
+        {
+            std::istringstream words(line);
+            std::string directive, name;
+            words >> directive >> name;
+            if(directive != "#define" || code.find(name) != std::string::npos)
+                used += line + "\n";
+        }
+        return used;
+    }
+
+    static bool& parallelCompile()
+    {
+        static bool enabled = false;
+        return enabled;
+    }
+
+    static std::map<std::string, unsigned int>& uniformBlockBindings()
+    {
+        static std::map<std::string, unsigned int> bindings;
+        return bindings;
+    }
+
+    // Block bindings are reset by every link (and binary load), so they're set after each
+    void bindUniformBlocks()
+    {
+        const std::map<std::string, unsigned int> &bindings = uniformBlockBindings();
+        for(std::map<std::string, unsigned int>::const_iterator i = bindings.begin(); i != bindings.end(); ++i)
+        {
+            unsigned int index = glGetUniformBlockIndex(ID, i->first.c_str());
+            if(index != GL_INVALID_INDEX)
+                glUniformBlockBinding(ID, index, i->second);
+        }
+    }
+
+    static std::string& cacheDirectory()
+    {
+        static std::string directory;
+        return directory;
+    }
+
+    // Program Binary Cache
+    // --------------------
+    // The file is named by a 64-bit FNV-1a hash of every stage's final source (defines included) and of the
+    // vendor, renderer and version strings, so a driver update misses instead of loading a stale binary. Empty
+    // when the cache is off or the context can't hand out program binaries (GL 4.1 / ARB_get_program_binary).
+    static std::string programCachePath(const std::string &sources)
+    {
+        const std::string &directory = cacheDirectory();
+        if(directory.empty() || !GLAD_GL_VERSION_4_1)
+            return std::string();
+
+        int formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        if(formatCount <= 0)
+            return std::string();
+
+        const GLenum driverStrings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+        unsigned long long hash = 14695981039346656037ull;
+        for(unsigned int i = 0; i < 3; ++i)
+        {
+            const char* value = reinterpret_cast<const char*>(glGetString(driverStrings[i]));
+            for(; value != NULL && *value != '\0'; ++value)
+                hash = (hash ^ static_cast<unsigned char>(*value)) * 1099511628211ull;
+            hash = (hash ^ 0xffu) * 1099511628211ull;
+        }
+        for(std::string::size_type i = 0; i < sources.size(); ++i)
+            hash = (hash ^ static_cast<unsigned char>(sources[i])) * 1099511628211ull;
+
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", hash);
+        return directory + "/" + name;
+    }
+
+    // Creates the program from the cached binary at path. False when there is none or the driver turns it down,
+    // and the caller compiles as usual (and overwrites the file).
+    bool loadProgramBinary(const std::string &path, bool separable = false)
+    {
+        if(path.empty())
+            return false;
+
+        std::ifstream file(path.c_str(), std::ios::binary);
+        GLenum format = 0;
+        int length = 0;
+        file.read(reinterpret_cast<char*>(&format), sizeof(format));
+        file.read(reinterpret_cast<char*>(&length), sizeof(length));
+        if(!file || length <= 0)
+            return false;
+
+        std::vector<char> binary(length);
+        file.read(binary.data(), length);
+        if(!file)
+            return false;
+
+        ID = glCreateProgram();
+        if(separable)
+            glProgramParameteri(ID, GL_PROGRAM_SEPARABLE, GL_TRUE);
+        glProgramBinary(ID, format, binary.data(), length);
+        int success = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        if(success)
+        {
+            bindUniformBlocks();
+            return true;
+        }
+
+        glDeleteProgram(ID);
+        return false;
+    }
+
+    // Starts linking the program with its shaders attached. Nothing here waits for the driver, finalize checks
+    // the result and caches it under path.
+    void linkProgram(const std::string &path)
+    {
+        if(!path.empty())
+            glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(ID);
+        linkPending = true;
+        pendingCachePath = path;
+    }
+
+    void saveProgramBinary(const std::string &path)
+    {
+        if(path.empty())
+            return;
+
+        int length = 0;
+        glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+        if(length <= 0)
+            return;
+
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(ID, length, NULL, &format, binary.data());
+
+#ifdef _WIN32
+        _mkdir(cacheDirectory().c_str());
+#else
+        mkdir(cacheDirectory().c_str(), 0755);
+#endif
+        std::ofstream file(path.c_str(), std::ios::binary);
+        file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+        file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        file.write(binary.data(), length);
+        if(!file)
+            std::cout << "ERROR::SHADER::CACHE_NOT_WRITTEN: " << path << std::endl;
+    }
+
+    static const char* stageName(unsigned int shader)
+    {
+        int type = 0;
+        glGetShaderiv(shader, GL_SHADER_TYPE, &type);
+        switch(type)
+        {
+        case GL_VERTEX_SHADER: return "VERTEX";
+        case GL_FRAGMENT_SHADER: return "FRAGMENT";
+        case GL_GEOMETRY_SHADER: return "GEOMETRY";
+        case GL_TESS_CONTROL_SHADER: return "TESS_CONTROL";
+        case GL_TESS_EVALUATION_SHADER: return "TESS_EVALUATION";
+        case GL_COMPUTE_SHADER: return "COMPUTE";
+        default: return "UNKNOWN";
+        }
+    }
+
+    static std::string readFile(const char* path)
+    {
+        std::ifstream file;
+        file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        try
+        {
+            file.open(path);
+            std::stringstream stream;
+            stream << file.rdbuf();
+            file.close();
+            return stream.str();
+        }
+        catch(std::ifstream::failure& e)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+        }
+        return std::string();
+    }
+
+    // Puts the defines right after the #version line, then resets the line numbering so compile errors still
+    // point at the lines of the file
+    static std::string injectDefines(const std::string &code, const std::string &defines)
+    {
+        if(defines.empty())
+            return code;
+
+        std::string::size_type version = code.find("#version");
+        std::string::size_type lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+        if(lineEnd == std::string::npos)
+            return defines + code;
+        return code.substr(0, lineEnd + 1) + defines + "#line 2\n" + code.substr(lineEnd + 1);
+    }
+
     // Utility function for checking shader compilation/linking errors
     // ---------------------------------------------------------------
     void checkCompileErrors(unsigned int shader, std::string type)
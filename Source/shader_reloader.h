@@ -0,0 +1,180 @@
+#ifndef SHADER_RELOADER_H
+#define SHADER_RELOADER_H
+
+#include "shader.h"
+#include "shader_variants.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Hot shader reload. Watches the shader directory and its subdirectories (inotify, Linux only) and rebuilds the
+// watched Shaders that use a file once it's saved. The rebuild is only submitted, and swapped in by a later
+// update when the driver is done with it, if it linked: a shader with errors keeps running the old program.
+// Unchanged stages of a pipeline come from the stage cache, so only the edited one compiles.
+// -------------------------------------------------------------------------------------------------------------
+class ShaderReloader
+{
+public:
+    // directory is the prefix the Shaders were given their paths with, e.g. "shaders"
+    explicit ShaderReloader(const std::string &directory)
+        : inotify(-1)
+    {
+#ifdef __linux__
+        inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if(inotify < 0)
+        {
+            std::cout << "ERROR::SHADER_RELOADER:: inotify_init1 failed, no hot reload" << std::endl;
+            return;
+        }
+
+        addWatch(directory);
+        DIR* root = opendir(directory.c_str());
+        if(root == NULL)
+            return;
+        while(dirent* entry = readdir(root))
+        {
+            if(entry->d_type == DT_DIR && entry->d_name[0] != '.')
+                addWatch(directory + "/" + entry->d_name);
+        }
+        closedir(root);
+#else
+        std::cout << "SHADER_RELOADER:: Hot reload needs inotify (Linux), " << directory << " isn't watched" << std::endl;
+#endif
+    }
+
+    ~ShaderReloader()
+    {
+#ifdef __linux__
+        if(inotify >= 0)
+            close(inotify);
+#endif
+    }
+
+    ShaderReloader(const ShaderReloader&) = delete;
+    ShaderReloader& operator=(const ShaderReloader&) = delete;
+
+    // The Shader must outlive the reloader and stay where it is
+    void watch(Shader &shader)
+    {
+        shaders.push_back(&shader);
+    }
+
+    // All variants, including the ones compiled later
+    void watch(ShaderVariants &variants)
+    {
+        variantSets.push_back(&variants);
+    }
+
+    // Once a frame, before anything is drawn: starts rebuilds for the files saved since the last call and swaps
+    // in the ones that are done
+    void update()
+    {
+        std::vector<std::string> changed;
+        readEvents(changed);
+        for(unsigned int i = 0; i < changed.size(); ++i)
+        {
+            for(unsigned int j = 0; j < shaders.size(); ++j)
+                startRebuild(*shaders[j], changed[i]);
+            for(unsigned int j = 0; j < variantSets.size(); ++j)
+                variantSets[j]->forEachVariant([&](Shader &shader) { startRebuild(shader, changed[i]); });
+        }
+
+        for(unsigned int i = 0; i < pending.size(); )
+        {
+            if(!pending[i].fresh.ready())
+            {
+                ++i;
+                continue;
+            }
+
+            if(pending[i].shader->replaceWith(pending[i].fresh))
+                std::cout << "SHADER_RELOADER:: Reloaded " << pending[i].path << std::endl;
+            else
+                std::cout << "SHADER_RELOADER:: " << pending[i].path << " failed, keeping the previous program" << std::endl;
+            pending.erase(pending.begin() + i);
+        }
+    }
+
+private:
+    struct Rebuild
+    {
+        Shader* shader;
+        Shader fresh;
+        std::string path;       // That triggered it
+    };
+
+    int inotify;
+    std::vector<std::string> directories;      // By watch descriptor
+    std::vector<Shader*> shaders;
+    std::vector<ShaderVariants*> variantSets;
+    std::vector<Rebuild> pending;
+
+    void addWatch(const std::string &directory)
+    {
+#ifdef __linux__
+        // Editors either write the file in place or write a new one and rename it over
+        int descriptor = inotify_add_watch(inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if(descriptor < 0)
+        {
+            std::cout << "ERROR::SHADER_RELOADER:: Can't watch " << directory << std::endl;
+            return;
+        }
+        if(directories.size() <= static_cast<unsigned int>(descriptor))
+            directories.resize(descriptor + 1);
+        directories[descriptor] = directory;
+#endif
+    }
+
+    // Paths of the files saved since the last call, each once
+    void readEvents(std::vector<std::string> &changed)
+    {
+#ifdef __linux__
+        if(inotify < 0)
+            return;
+
+        alignas(inotify_event) char buffer[4096];
+        while(true)
+        {
+            ssize_t length = read(inotify, buffer, sizeof(buffer));
+            if(length <= 0)
+                break;
+
+            for(char* event = buffer; event < buffer + length; )
+            {
+                const inotify_event* e = reinterpret_cast<const inotify_event*>(event);
+                if(e->len > 0 && e->wd >= 0 && static_cast<unsigned int>(e->wd) < directories.size())
+                {
+                    std::string path = directories[e->wd] + "/" + e->name;
+                    bool seen = false;
+                    for(unsigned int i = 0; i < changed.size() && !seen; ++i)
+                        seen = changed[i] == path;
+                    if(!seen)
+                        changed.push_back(path);
+                }
+                event += sizeof(inotify_event) + e->len;
+            }
+        }
+#else
+        (void)changed;
+#endif
+    }
+
+    // A rebuild still under way for the shader is left to finish, the newer one swaps in after it
+    void startRebuild(Shader &shader, const std::string &path)
+    {
+        if(!shader.usesSource(path))
+            return;
+
+        Rebuild rebuild = { &shader, shader.rebuild(), path };
+        pending.push_back(rebuild);
+    }
+};
+
+#endif
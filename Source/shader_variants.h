@@ -0,0 +1,67 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include "shader.h"
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Permutations of one vertex / fragment shader pair, keyed by a feature bitmask. Bit i of the mask adds
+// "#define featureDefines[i]" to both stages, so features the shaders #ifdef out cost nothing at all when off.
+// A variant is compiled the first time it's asked for, or by submitAll, and kept from then on.
+// -------------------------------------------------------------------------------------------------------------
+class ShaderVariants
+{
+public:
+    // featureDefines[i] is what bit i defines, e.g. "HAS_SPOT" or "NUM_POINT_LIGHTS 1"
+    ShaderVariants(const char* vertexPath, const char* fragmentPath, const std::vector<std::string> &featureDefines)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), featureDefines(featureDefines)
+    {
+    }
+
+    // The program for these features. Uniforms are per program, so set them after switching variants. Hold on
+    // to it by reference or pointer, a copy would check the link (and write the binary cache) on its own again.
+    Shader& get(unsigned int features)
+    {
+        std::map<unsigned int, Shader>::iterator variant = variants.find(features);
+        if(variant != variants.end())
+            return variant->second;
+
+        std::string defines;
+        for(unsigned int i = 0; i < featureDefines.size(); ++i)
+        {
+            if(features & (1u << i))
+                defines += "#define " + featureDefines[i] + "\n";
+        }
+
+        std::cout << "SHADER_VARIANTS::" << fragmentPath << ":: Compiling variant " << features << std::endl;
+        Shader shader(vertexPath.c_str(), fragmentPath.c_str(), defines);
+        return variants.insert(std::make_pair(features, shader)).first->second;
+    }
+
+    // Submits every combination of the features, so no variant has to compile (and allocate) in the middle of a
+    // frame. With the parallel compile they all build on the driver's threads while the models load.
+    void submitAll()
+    {
+        for(unsigned int features = 0; features < (1u << featureDefines.size()); ++features)
+            get(features);
+    }
+
+    // Calls function with each variant compiled so far (see ShaderReloader)
+    template<typename Function>
+    void forEachVariant(Function function)
+    {
+        for(std::map<unsigned int, Shader>::iterator variant = variants.begin(); variant != variants.end(); ++variant)
+            function(variant->second);
+    }
+
+private:
+    std::string vertexPath, fragmentPath;
+    std::vector<std::string> featureDefines;
+    std::map<unsigned int, Shader> variants;
+};
+
+#endif
@@ -0,0 +1,123 @@
+#version 430 core
+layout (local_size_x = 64) in;
+
+// GPU-driven culling of a static batch (see static_batch.h): one invocation per meshlet. Meshlets that pass the
+// frustum, cone and Hi-Z tests are appended to their material's range of the indirect draw buffer, which was
+// cleared to zero, so the unused tail of each range draws nothing.
+
+struct Meshlet
+{
+    vec4 sphere;            // World space center and radius
+    vec4 cone;              // Axis and cutoff
+    uint firstIndex;
+    uint indexCount;
+    uint firstCommand;      // Of its material's range
+    uint flags;             // Material index << 1 | backface culling
+};
+
+struct DrawCommand
+{
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout (std430, binding = 0) readonly buffer Meshlets { Meshlet meshlets[]; };
+layout (std430, binding = 1) writeonly buffer Commands { DrawCommand commands[]; };
+layout (std430, binding = 2) buffer Counters { uint counters[]; };     // One per material
+layout (std430, binding = 3) readonly buffer Pyramid { float pyramid[]; };
+
+uniform uint meshletCount;
+uniform vec4 planes[6];         // Normalized, pointing inwards
+uniform vec3 cameraPosition;
+uniform bool cullBackfaces;
+
+// Hi-Z pyramid of the occlusion culler (see occlusion_culler.h)
+uniform bool occlusion;
+uniform mat4 occlusionViewProjection;
+uniform vec2 occlusionSize;
+uniform uvec3 occlusionLevels[24];     // Offset, width, height
+uniform int occlusionLevelCount;
+
+bool frustumVisible(vec3 center, float radius)
+{
+    for(int i = 0; i < 6; ++i)
+    {
+        if(dot(planes[i].xyz, center) + planes[i].w < -radius)
+            return false;
+    }
+    return true;
+}
+
+bool backfacing(Meshlet meshlet)
+{
+    vec3 toCenter = meshlet.sphere.xyz - cameraPosition;
+    return dot(toCenter, meshlet.cone.xyz) >= meshlet.cone.w * length(toCenter) + meshlet.sphere.w;
+}
+
+// The box around the sphere against the pyramid level where it covers at most 2x2 texels, as
+// OcclusionCuller::visible does on the CPU
+bool occluded(vec3 center, float radius)
+{
+    vec2 rectMin = vec2(1e30);
+    vec2 rectMax = vec2(-1e30);
+    float nearest = 1.0;
+    for(int i = 0; i < 8; ++i)
+    {
+        vec3 corner = center + radius * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = occlusionViewProjection * vec4(corner, 1.0);
+        if(clip.w <= 1e-5)
+            return false;
+
+        vec3 ndc = clip.xyz / clip.w;
+        rectMin = min(rectMin, ndc.xy);
+        rectMax = max(rectMax, ndc.xy);
+        nearest = min(nearest, ndc.z);
+    }
+
+    if(rectMax.x < -1.0 || rectMax.y < -1.0 || rectMin.x > 1.0 || rectMin.y > 1.0)
+        return false;
+
+    vec2 texel0 = (max(rectMin, vec2(-1.0)) * 0.5 + 0.5) * occlusionSize;
+    vec2 texel1 = (min(rectMax, vec2(1.0)) * 0.5 + 0.5) * occlusionSize;
+    float size = max(texel1.x - texel0.x, texel1.y - texel0.y);
+    int levelIndex = size > 1.0 ? int(ceil(log2(size))) : 0;
+    levelIndex = min(levelIndex, occlusionLevelCount - 1);
+
+    uvec3 level = occlusionLevels[levelIndex];
+    float scale = 1.0 / float(1 << levelIndex);
+    uvec2 t0 = min(uvec2(texel0 * scale), level.yz - 1u);
+    uvec2 t1 = min(uvec2(texel1 * scale), level.yz - 1u);
+
+    float farthest = 0.0;
+    for(uint y = t0.y; y <= t1.y; ++y)
+    {
+        for(uint x = t0.x; x <= t1.x; ++x)
+            farthest = max(farthest, pyramid[level.x + y * level.y + x]);
+    }
+    return nearest * 0.5 + 0.5 > farthest;
+}
+
+void main()
+{
+    uint id = gl_GlobalInvocationID.x;
+    if(id >= meshletCount)
+        return;
+
+    Meshlet meshlet = meshlets[id];
+    if(!frustumVisible(meshlet.sphere.xyz, meshlet.sphere.w))
+        return;
+    if(cullBackfaces && (meshlet.flags & 1u) != 0u && backfacing(meshlet))
+        return;
+    if(occlusion && occluded(meshlet.sphere.xyz, meshlet.sphere.w))
+        return;
+
+    uint slot = meshlet.firstCommand + atomicAdd(counters[meshlet.flags >> 1], 1u);
+    commands[slot].count = meshlet.indexCount;
+    commands[slot].instanceCount = 1u;
+    commands[slot].firstIndex = meshlet.firstIndex;
+    commands[slot].baseVertex = 0;
+    commands[slot].baseInstance = 0u;
+}
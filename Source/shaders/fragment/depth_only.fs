@@ -0,0 +1,6 @@
+#version 330 core
+
+// Depth-only passes (occluders): nothing to shade, only the depth gets written
+void main()
+{
+}
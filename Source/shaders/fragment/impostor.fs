@@ -0,0 +1,36 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 AtlasCoords;
+in vec3 WorldPos;
+in vec3 FrameOffset;
+in mat3 ModelRotation;
+
+uniform sampler2D albedoAtlas;
+uniform sampler2D normalDepthAtlas;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+// Single directional light, the impostors are far away
+uniform vec3 lightDirection;
+uniform vec3 lightAmbient;
+uniform vec3 lightDiffuse;
+
+void main()
+{
+    vec4 albedo = texture(albedoAtlas, AtlasCoords);
+    if(albedo.a < 0.5)
+        discard;
+
+    vec4 normalDepth = texture(normalDepthAtlas, AtlasCoords);
+    vec3 normal = normalize(ModelRotation * (normalDepth.xyz * 2.0 - 1.0));
+
+    // Move the fragment onto the baked surface so impostors intersect the rest of the scene correctly
+    vec3 surface = WorldPos + FrameOffset * (normalDepth.w * 2.0 - 1.0);
+    vec4 clip = projection * view * vec4(surface, 1.0);
+    gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+
+    float diff = max(dot(normal, normalize(-lightDirection)), 0.0);
+    FragColor = vec4((lightAmbient + lightDiffuse * diff) * albedo.rgb, 1.0);
+}
@@ -0,0 +1,23 @@
+#version 330 core
+layout (location = 0) out vec4 Albedo;
+layout (location = 1) out vec4 NormalDepth;
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+
+uniform sampler2D texture_diffuse1;
+
+// Frame being baked (model space)
+uniform vec3 impostorCenter;
+uniform vec3 impostorDirection;
+uniform float impostorRadius;
+
+void main()
+{
+    Albedo = vec4(texture(texture_diffuse1, TexCoords).rgb, 1.0);
+
+    // Model space normal, and the surface's offset towards the viewer mapped from [-radius, radius] to [0, 1]
+    float depth = dot(FragPos - impostorCenter, impostorDirection) / impostorRadius * 0.5 + 0.5;
+    NormalDepth = vec4(normalize(Normal) * 0.5 + 0.5, depth);
+}
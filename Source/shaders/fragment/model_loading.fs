@@ -1,5 +1,11 @@
 #version 330 core
 
+// Variant features (see shader_variants.h): NUM_POINT_LIGHTS point lights and HAS_SPOT for the flashlight. Lights
+// that are switched off are compiled out instead of evaluated with black colors.
+#ifndef NUM_POINT_LIGHTS
+#define NUM_POINT_LIGHTS 0
+#endif
+
 out vec4 FragColor;
 
 struct Material
@@ -47,8 +53,6 @@ struct SpotLight
     vec3 specular;
 };
 
-#define NR_POINT_LIGHTS 1
-
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
@@ -56,8 +60,12 @@ in vec2 TexCoords;
 
 uniform vec3 viewPos;
 uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
+#if NUM_POINT_LIGHTS > 0
+uniform PointLight pointLights[NUM_POINT_LIGHTS];
+#endif
+#ifdef HAS_SPOT
 uniform SpotLight spotLight;
+#endif
 uniform Material material;
 
 // Function Prototypes
@@ -86,15 +94,19 @@ void main()
     // Phase 2 : Point Lights
     // ----------------------
 
-    for(int i = 0; i < NR_POINT_LIGHTS; ++i)
+#if NUM_POINT_LIGHTS > 0
+    for(int i = 0; i < NUM_POINT_LIGHTS; ++i)
     {
         result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
     }
+#endif
 
     // Phase 3 : Spotlight
     // -------------------
 
+#ifdef HAS_SPOT
     result += CalcSpotLight(spotLight, norm, FragPos, viewDir);
+#endif
 
     FragColor = vec4(result, 1.0);
 }
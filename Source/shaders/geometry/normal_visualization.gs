@@ -10,15 +10,11 @@ in VS_OUT
 const float MAGNITUDE = 0.011;
 
 uniform mat4 projection;
-uniform mat4 model;
 
 void GenerateLine(int index)
 {
     gl_Position = projection * gl_in[index].gl_Position;
 
-    // if(model[1][1] < 0.5)
-    //     return;
-
     if(gs_in[index].normal.y < 9.0)
         return;
 
@@ -0,0 +1,58 @@
+#version 330 core
+layout (location = 0) in vec2 aCorner;      // Quad corner in [-1, 1]
+layout (location = 1) in mat4 aModel;       // Per instance (locations 1 - 4)
+
+out vec2 AtlasCoords;
+out vec3 WorldPos;
+out vec3 FrameOffset;       // World space vector from the quad to the front of the bounding sphere
+out mat3 ModelRotation;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 cameraPosition;
+uniform vec4 plane;
+
+uniform vec3 impostorCenter;
+uniform float impostorRadius;
+uniform float framesPerSide;
+
+vec2 octEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.xy;
+    if(n.z < 0.0)
+        e = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return e;
+}
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+void main()
+{
+    ModelRotation = mat3(aModel);
+    vec3 center = vec3(aModel * vec4(impostorCenter, 1.0));
+
+    // Nearest baked view to the model space direction towards the camera
+    vec3 toCamera = normalize(transpose(ModelRotation) * (cameraPosition - center));
+    vec2 cell = floor((octEncode(toCamera) * 0.5 + 0.5) * (framesPerSide - 1.0) + 0.5);
+    vec3 direction = octDecode(cell / (framesPerSide - 1.0) * 2.0 - 1.0);
+
+    // Same basis the frame was baked with (Impostor::frameUp and glm::lookAt)
+    vec3 worldUp = abs(direction.y) > 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+    vec3 right = normalize(cross(worldUp, direction));
+    vec3 up = cross(direction, right);
+
+    vec3 local = impostorCenter + (right * aCorner.x + up * aCorner.y) * impostorRadius;
+    WorldPos = vec3(aModel * vec4(local, 1.0));
+    FrameOffset = ModelRotation * direction * impostorRadius;
+    AtlasCoords = (cell + aCorner * 0.5 + 0.5) / framesPerSide;
+
+    gl_Position = projection * view * vec4(WorldPos, 1.0);
+    gl_ClipDistance[0] = dot(vec4(WorldPos, 1.0), plane);
+}
@@ -1,5 +1,5 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
+layout (location = 0) in vec4 aPos;     // w holds the bitangent sign in the compact formats
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 
@@ -7,21 +7,51 @@ out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
 
-uniform mat4 model;
+// Depth pre-pass and lighting pass run this with different fragment shaders, GL_EQUAL needs the same depth
+invariant gl_Position;
+
+// Per-object constants (see object_constants.h)
+layout (std140) uniform Object
+{
+    mat4 model;
+    mat4 normalMatrix;      // mat3 in the upper left, inverted on the CPU
+};
+
 uniform mat4 view;
 uniform mat4 projection;
 
 // const vec4 plane = vec4(0, -1, 0, 1);
 uniform vec4 plane;
 
+// Compact vertex formats (see vertex_format.h): positions are offset + aPos.xyz * scale, normals are octahedral
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+uniform bool octahedralNormals;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;         // Inefficient (Should avoid)
+    vec3 position = positionOffset + aPos.xyz * positionScale;
+    vec3 normal = octahedralNormals ? octDecode(aNormal.xy) : aNormal;
+
+    FragPos = vec3(model * vec4(position, 1.0));
+    Normal = mat3(normalMatrix) * normal;
     TexCoords = aTexCoords;
 
     gl_Position = projection * view * vec4(FragPos, 1.0);
 
+    // Only the water passes clip (CLIP_PLANE variant, see shader_variants.h), GL_CLIP_DISTANCE0 stays enabled
+#ifdef CLIP_PLANE
     gl_ClipDistance[0] = dot(vec4(FragPos, 1.0), plane);
+#else
+    gl_ClipDistance[0] = 0.0;
+#endif
     // gl_ClipDistance[0] = -0.0;
 }
\ No newline at end of file
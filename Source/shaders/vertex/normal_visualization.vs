@@ -1,5 +1,5 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
+layout (location = 0) in vec4 aPos;     // w holds the bitangent sign in the compact formats
 layout (location = 1) in vec3 aNormal;
 
 out VS_OUT
@@ -8,11 +8,33 @@ out VS_OUT
 } vs_out;
 
 uniform mat4 view;
-uniform mat4 model;
+
+// Per-object constants (see object_constants.h)
+layout (std140) uniform Object
+{
+    mat4 model;
+    mat4 normalMatrix;      // mat3 in the upper left, inverted on the CPU
+};
+
+// Compact vertex formats (see vertex_format.h): positions are offset + aPos.xyz * scale, normals are octahedral
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+uniform bool octahedralNormals;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
 
 void main()
 {
-    mat3 normalMatrix = mat3(transpose(inverse(view * model)));
-    vs_out.normal = vec3(vec4(normalMatrix * aNormal, 0.0));
-    gl_Position = view * model * vec4(aPos, 1.0);
+    vec3 position = positionOffset + aPos.xyz * positionScale;
+    vec3 normal = octahedralNormals ? octDecode(aNormal.xy) : aNormal;
+
+    // The view is a rotation and translation, its normal matrix is just its own upper left
+    vs_out.normal = mat3(view) * (mat3(normalMatrix) * normal);
+    gl_Position = view * model * vec4(position, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,430 @@
+#ifndef SOFTWARE_RASTERIZER_H
+#define SOFTWARE_RASTERIZER_H
+
+#include <glm/glm.hpp>
+
+#include "model.h"
+#include "scratch_arena.h"
+#include "mesh_simplifier.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// SSE2 is part of every x86-64 target, so it needs no extra compiler flags; other targets use the scalar loop
+#if defined(__SSE2__) || defined(_M_X64)
+#define SOFTWARE_RASTERIZER_SSE 1
+#include <emmintrin.h>
+#else
+#define SOFTWARE_RASTERIZER_SSE 0
+#endif
+
+// Depth-only software rasterizer for occlusion culling, no GPU involved. Occluders are simplified copies of
+// static models in world space, pulled back behind the real surface so they never hide what it doesn't. Every
+// frame they are transformed once, then the depth buffer is split into horizontal bands that worker threads
+// rasterize in parallel, four pixels at a time. The result is a window space depth buffer ([0, 1], row 0 at the
+// bottom, like glReadPixels) for OcclusionCuller::setDepth, available in the same frame.
+// ------------------------------------------------------------------------------------------------------------
+class SoftwareRasterizer
+{
+public:
+    // width must be a multiple of 4. threadCount counts the calling thread, which rasterizes a band too.
+    SoftwareRasterizer(unsigned int width, unsigned int height, unsigned int threadCount)
+        : width(width & ~3u), height(height), bandCount(std::max(1u, std::min(threadCount, height))),
+          depthBuffer((width & ~3u) * height, 1.0f), generation(0), pendingBands(0), quit(false), lastRenderTime(0.0f)
+    {
+        for(unsigned int i = 1; i < bandCount; ++i)
+            workers.push_back(std::thread(&SoftwareRasterizer::workerLoop, this, i));
+    }
+
+    ~SoftwareRasterizer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        startCondition.notify_all();
+        for(unsigned int i = 0; i < workers.size(); ++i)
+            workers[i].join();
+    }
+
+    SoftwareRasterizer(const SoftwareRasterizer&) = delete;
+    SoftwareRasterizer& operator=(const SoftwareRasterizer&) = delete;
+
+    // Adds the model's meshes, placed by transform, simplified to about triangleRatio of their triangles but no
+    // further than maxError (world space, e.g. what an occlusion texel covers at the nearest distance that
+    // matters). The model must still hold its vertices (RESIDENCY_KEEP_ALL).
+    template<typename Layout>
+    void addOccluder(const BasicModel<Layout> &model, const glm::mat4 &transform, float triangleRatio, float maxError)
+    {
+        unsigned int before = static_cast<unsigned int>(indices.size() / 3);
+        for(unsigned int i = 0; i < model.meshes.size(); ++i)
+            addMesh(model.meshes[i], transform, triangleRatio, maxError);
+        for(unsigned int i = 0; i < model.skinnedMeshes.size(); ++i)
+            addMesh(model.skinnedMeshes[i], transform, triangleRatio, maxError);
+
+        std::cout << "SOFTWARE_RASTERIZER::" << model.directory << ":: " << indices.size() / 3 - before
+                  << " occluder triangles" << std::endl;
+    }
+
+    // Rasterizes every occluder as seen through viewProjection
+    void render(const glm::mat4 &viewProjection)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        // Window space vertices. Those in front of the near plane (or behind the camera) are flagged, and the
+        // triangles using them are skipped: the GPU clips those parts away, written here they would be nearer
+        // than everything and hide what is seen through the gap.
+        for(unsigned int i = 0; i < positions.size(); ++i)
+        {
+            glm::vec4 clip = viewProjection * glm::vec4(positions[i], 1.0f);
+            ScreenVertex &v = screenVertices[i];
+            v.valid = clip.w > 1e-5f && clip.z >= -clip.w;
+            if(!v.valid)
+                continue;
+
+            float invW = 1.0f / clip.w;
+            v.x = (clip.x * invW * 0.5f + 0.5f) * width;
+            v.y = (clip.y * invW * 0.5f + 0.5f) * height;
+            v.z = clip.z * invW * 0.5f + 0.5f;
+        }
+
+        // Bands 1.. go to the workers, band 0 is ours
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pendingBands = bandCount - 1;
+            ++generation;
+        }
+        startCondition.notify_all();
+
+        rasterizeBand(0);
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            doneCondition.wait(lock, [this] { return pendingBands == 0; });
+        }
+
+        lastRenderTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    const float* depth() const
+    {
+        return depthBuffer.data();
+    }
+
+    // Milliseconds the last render took
+    float renderTime() const
+    {
+        return lastRenderTime;
+    }
+
+    unsigned int triangleCount() const
+    {
+        return static_cast<unsigned int>(indices.size() / 3);
+    }
+
+private:
+    struct ScreenVertex
+    {
+        float x, y, z;
+        bool valid;             // Beyond the near plane, so safe to rasterize
+    };
+
+    unsigned int width, height;
+    unsigned int bandCount;
+    std::vector<float> depthBuffer;
+
+    // Occluders in world space, and their vertices in window space for the current frame
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+    std::vector<ScreenVertex> screenVertices;
+
+    // Worker threads, woken once per render for their band
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable startCondition;
+    std::condition_variable doneCondition;
+    unsigned int generation;
+    unsigned int pendingBands;
+    bool quit;
+
+    float lastRenderTime;
+
+    template<typename MeshLayout>
+    void addMesh(const BasicMesh<MeshLayout> &mesh, const glm::mat4 &transform, float triangleRatio, float maxError)
+    {
+        if(mesh.residency != RESIDENCY_KEEP_ALL || mesh.indices.empty())
+        {
+            std::cout << "ERROR::SOFTWARE_RASTERIZER:: Mesh was loaded without RESIDENCY_KEEP_ALL, skipping it" << std::endl;
+            return;
+        }
+
+        ScratchArena scratch;
+        unsigned int indexCount = mesh.indexCount;     // LOD 0, the LOD chain follows it in indices
+        unsigned int* simplified = scratch.allocate<unsigned int>(indexCount);
+        unsigned int target = static_cast<unsigned int>(indexCount / 3 * triangleRatio) * 3;
+
+        // The simplifier measures in the mesh's own space
+        glm::mat3 linear(transform);
+        float scale = std::max(glm::length(linear[0]), std::max(glm::length(linear[1]), glm::length(linear[2])));
+        float error;
+        unsigned int count = simplifyMesh(simplified, mesh.indices.data(), indexCount, mesh.vertices.data(),
+                                          static_cast<unsigned int>(mesh.vertices.size()), target, maxError / scale,
+                                          error, scratch);
+
+        // Keep only the vertices the simplified triangles still use
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(linear));
+        unsigned int firstVertex = static_cast<unsigned int>(positions.size());
+        unsigned int firstIndex = static_cast<unsigned int>(indices.size());
+        glm::vec3* normals = scratch.allocate<glm::vec3>(mesh.vertices.size());
+        unsigned int* remap = scratch.allocate<unsigned int>(mesh.vertices.size());
+        std::fill(remap, remap + mesh.vertices.size(), ~0u);
+        for(unsigned int i = 0; i < count; ++i)
+        {
+            unsigned int v = simplified[i];
+            if(remap[v] == ~0u)
+            {
+                remap[v] = static_cast<unsigned int>(positions.size());
+                normals[remap[v] - firstVertex] = safeNormal(normalMatrix * mesh.vertices[v].Normal);
+                positions.push_back(glm::vec3(transform * glm::vec4(mesh.vertices[v].Position, 1.0f)));
+            }
+            indices.push_back(remap[v]);
+        }
+        screenVertices.resize(positions.size());
+
+        // The quadric error bounds the mean distance to the collapsed surface, not the farthest, so a collapse can
+        // still leave the occluder in front of the real surface (say flat across a hollow). Measure how far it
+        // sticks out at the real vertices and pull it back along the normals by that much.
+        float front = frontDeviation(mesh, transform, normalMatrix, firstIndex, 4.0f * maxError, scratch);
+        for(unsigned int i = firstVertex; i < positions.size(); ++i)
+            positions[i] -= normals[i - firstVertex] * front;
+        if(front > maxError)
+            std::cout << "SOFTWARE_RASTERIZER:: Occluder pulled back " << front << " behind the surface" << std::endl;
+    }
+
+    static glm::vec3 safeNormal(const glm::vec3 &normal)
+    {
+        float length = glm::length(normal);
+        return length > 1e-12f ? normal / length : glm::vec3(0.0f);
+    }
+
+    // The farthest the occluder triangles from firstIndex on lie in front of the mesh, looking outwards from
+    // each of its vertices along the normal up to searchDistance. Triangles are binned in a grid first.
+    template<typename MeshLayout>
+    float frontDeviation(const BasicMesh<MeshLayout> &mesh, const glm::mat4 &transform, const glm::mat3 &normalMatrix,
+                         unsigned int firstIndex, float searchDistance, ScratchArena &scratch) const
+    {
+        unsigned int triangleCount = static_cast<unsigned int>(indices.size() - firstIndex) / 3;
+        if(triangleCount == 0 || searchDistance <= 0.0f)
+            return 0.0f;
+
+        glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+        for(unsigned int i = firstIndex; i < indices.size(); ++i)
+        {
+            boundsMin = glm::min(boundsMin, positions[indices[i]]);
+            boundsMax = glm::max(boundsMax, positions[indices[i]]);
+        }
+        boundsMin -= glm::vec3(searchDistance);
+        boundsMax += glm::vec3(searchDistance);
+        glm::vec3 extent = boundsMax - boundsMin;
+        float cellSize = std::max(searchDistance, std::max(extent.x, std::max(extent.y, extent.z)) / 32.0f);
+        glm::ivec3 cells = glm::max(glm::ivec3(extent / cellSize) + 1, glm::ivec3(1));
+
+        // Triangles of every cell their bounds overlap, as offsets into one list
+        unsigned int cellCount = cells.x * cells.y * cells.z;
+        unsigned int* cellStart = scratch.allocate<unsigned int>(cellCount + 1);
+        std::fill(cellStart, cellStart + cellCount + 1, 0u);
+        for(int pass = 0; pass < 2; ++pass)
+        {
+            unsigned int* cellTriangles = pass == 1 ? scratch.allocate<unsigned int>(cellStart[cellCount]) : nullptr;
+            for(unsigned int t = 0; t < triangleCount; ++t)
+            {
+                const unsigned int* triangle = &indices[firstIndex + t * 3];
+                glm::vec3 low = glm::min(positions[triangle[0]], glm::min(positions[triangle[1]], positions[triangle[2]]));
+                glm::vec3 high = glm::max(positions[triangle[0]], glm::max(positions[triangle[1]], positions[triangle[2]]));
+                glm::ivec3 c0 = glm::clamp(glm::ivec3((low - boundsMin) / cellSize), glm::ivec3(0), cells - 1);
+                glm::ivec3 c1 = glm::clamp(glm::ivec3((high - boundsMin) / cellSize), glm::ivec3(0), cells - 1);
+                for(int z = c0.z; z <= c1.z; ++z)
+                    for(int y = c0.y; y <= c1.y; ++y)
+                        for(int x = c0.x; x <= c1.x; ++x)
+                        {
+                            unsigned int cell = (z * cells.y + y) * cells.x + x;
+                            if(pass == 0)
+                                ++cellStart[cell + 1];
+                            else
+                                cellTriangles[cellStart[cell]++] = t;
+                        }
+            }
+
+            if(pass == 0)
+            {
+                for(unsigned int i = 0; i < cellCount; ++i)
+                    cellStart[i + 1] += cellStart[i];
+                continue;
+            }
+
+            // cellStart now holds the ends, the start of a cell is the end of the one before it
+            float front = 0.0f;
+            for(unsigned int v = 0; v < mesh.vertices.size(); ++v)
+            {
+                glm::vec3 origin = glm::vec3(transform * glm::vec4(mesh.vertices[v].Position, 1.0f));
+                glm::vec3 direction = safeNormal(normalMatrix * mesh.vertices[v].Normal);
+                glm::vec3 end = origin + direction * searchDistance;
+                glm::ivec3 c0 = glm::clamp(glm::ivec3((glm::min(origin, end) - boundsMin) / cellSize), glm::ivec3(0), cells - 1);
+                glm::ivec3 c1 = glm::clamp(glm::ivec3((glm::max(origin, end) - boundsMin) / cellSize), glm::ivec3(0), cells - 1);
+                for(int z = c0.z; z <= c1.z; ++z)
+                    for(int y = c0.y; y <= c1.y; ++y)
+                        for(int x = c0.x; x <= c1.x; ++x)
+                        {
+                            unsigned int cell = (z * cells.y + y) * cells.x + x;
+                            for(unsigned int i = cell == 0 ? 0 : cellStart[cell - 1]; i < cellStart[cell]; ++i)
+                            {
+                                const unsigned int* triangle = &indices[firstIndex + cellTriangles[i] * 3];
+                                float t = rayTriangle(origin, direction, positions[triangle[0]], positions[triangle[1]],
+                                                      positions[triangle[2]]);
+                                if(t > front && t <= searchDistance)
+                                    front = t;
+                            }
+                        }
+            }
+            return front;
+        }
+        return 0.0f;
+    }
+
+    // Distance along direction (unit length) to the triangle, either side, or -1 when the ray misses it
+    static float rayTriangle(const glm::vec3 &origin, const glm::vec3 &direction, const glm::vec3 &v0,
+                             const glm::vec3 &v1, const glm::vec3 &v2)
+    {
+        glm::vec3 edge1 = v1 - v0;
+        glm::vec3 edge2 = v2 - v0;
+        glm::vec3 p = glm::cross(direction, edge2);
+        float determinant = glm::dot(edge1, p);
+        if(std::fabs(determinant) < 1e-12f)
+            return -1.0f;
+
+        float inverse = 1.0f / determinant;
+        glm::vec3 s = origin - v0;
+        float u = glm::dot(s, p) * inverse;
+        if(u < 0.0f || u > 1.0f)
+            return -1.0f;
+        glm::vec3 q = glm::cross(s, edge1);
+        float v = glm::dot(direction, q) * inverse;
+        if(v < 0.0f || u + v > 1.0f)
+            return -1.0f;
+        return glm::dot(edge2, q) * inverse;
+    }
+
+    void workerLoop(unsigned int band)
+    {
+        unsigned int seen = 0;
+        while(true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                startCondition.wait(lock, [this, seen] { return quit || generation != seen; });
+                if(quit)
+                    return;
+                seen = generation;
+            }
+
+            rasterizeBand(band);
+
+            bool last;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                last = --pendingBands == 0;
+            }
+            if(last)
+                doneCondition.notify_one();
+        }
+    }
+
+    // Clears the band's rows and draws every occluder triangle touching them
+    void rasterizeBand(unsigned int band)
+    {
+        int bandStart = static_cast<int>(height * band / bandCount);
+        int bandEnd = static_cast<int>(height * (band + 1) / bandCount);
+        std::fill(depthBuffer.begin() + bandStart * width, depthBuffer.begin() + bandEnd * width, 1.0f);
+
+        for(unsigned int t = 0; t + 2 < indices.size(); t += 3)
+        {
+            const ScreenVertex *v0 = &screenVertices[indices[t]];
+            const ScreenVertex *v1 = &screenVertices[indices[t + 1]];
+            const ScreenVertex *v2 = &screenVertices[indices[t + 2]];
+            if(!v0->valid || !v1->valid || !v2->valid)
+                continue;
+
+            // Pixel bounds, clamped to the band
+            int minY = std::max(bandStart, static_cast<int>(std::floor(std::min(v0->y, std::min(v1->y, v2->y)))));
+            int maxY = std::min(bandEnd - 1, static_cast<int>(std::ceil(std::max(v0->y, std::max(v1->y, v2->y)))));
+            if(minY > maxY)
+                continue;
+            int minX = std::max(0, static_cast<int>(std::floor(std::min(v0->x, std::min(v1->x, v2->x)))));
+            int maxX = std::min(static_cast<int>(width) - 1, static_cast<int>(std::ceil(std::max(v0->x, std::max(v1->x, v2->x)))));
+            if(minX > maxX)
+                continue;
+            minX &= ~3;     // Four pixel aligned
+
+            // Both windings are occluders, make it counter-clockwise
+            float area = (v1->x - v0->x) * (v2->y - v0->y) - (v2->x - v0->x) * (v1->y - v0->y);
+            if(std::fabs(area) < 1e-8f)
+                continue;
+            if(area < 0.0f)
+            {
+                std::swap(v1, v2);
+                area = -area;
+            }
+
+            // Edge functions e = a * x + b * y + c, positive inside, and the depth plane, at pixel centers
+            float a0 = v1->y - v2->y, b0 = v2->x - v1->x, c0 = v1->x * v2->y - v1->y * v2->x;
+            float a1 = v2->y - v0->y, b1 = v0->x - v2->x, c1 = v2->x * v0->y - v2->y * v0->x;
+            float a2 = v0->y - v1->y, b2 = v1->x - v0->x, c2 = v0->x * v1->y - v0->y * v1->x;
+            float dzdx = ((v1->z - v0->z) * (v2->y - v0->y) - (v2->z - v0->z) * (v1->y - v0->y)) / area;
+            float dzdy = ((v2->z - v0->z) * (v1->x - v0->x) - (v1->z - v0->z) * (v2->x - v0->x)) / area;
+            float z0 = v0->z - dzdx * v0->x - dzdy * v0->y;
+
+            for(int y = minY; y <= maxY; ++y)
+            {
+                float py = y + 0.5f;
+                float* row = &depthBuffer[y * width];
+                for(int x = minX; x <= maxX; x += 4)
+                {
+                    float px = x + 0.5f;
+                    float e0 = a0 * px + b0 * py + c0;
+                    float e1 = a1 * px + b1 * py + c1;
+                    float e2 = a2 * px + b2 * py + c2;
+                    float z = z0 + dzdx * px + dzdy * py;
+#if SOFTWARE_RASTERIZER_SSE
+                    const __m128 steps = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+                    const __m128 zero = _mm_setzero_ps();
+                    __m128 inside = _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_set1_ps(e0), _mm_mul_ps(_mm_set1_ps(a0), steps)), zero),
+                                    _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_set1_ps(e1), _mm_mul_ps(_mm_set1_ps(a1), steps)), zero),
+                                               _mm_cmpge_ps(_mm_add_ps(_mm_set1_ps(e2), _mm_mul_ps(_mm_set1_ps(a2), steps)), zero)));
+                    if(_mm_movemask_ps(inside) == 0)
+                        continue;
+
+                    __m128 depth = _mm_add_ps(_mm_set1_ps(z), _mm_mul_ps(_mm_set1_ps(dzdx), steps));
+                    __m128 current = _mm_loadu_ps(row + x);
+                    __m128 nearer = _mm_min_ps(current, depth);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+#else
+                    for(int k = 0; k < 4; ++k)
+                    {
+                        if(e0 + a0 * k >= 0.0f && e1 + a1 * k >= 0.0f && e2 + a2 * k >= 0.0f)
+                            row[x + k] = std::min(row[x + k], z + dzdx * k);
+                    }
+#endif
+                }
+            }
+        }
+    }
+};
+
+#endif
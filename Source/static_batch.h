@@ -0,0 +1,560 @@
+#ifndef STATIC_BATCH_H
+#define STATIC_BATCH_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "model.h"
+#include "shader.h"
+#include "object_constants.h"
+#include "meshlet.h"
+#include "occlusion_culler.h"
+#include "resource_registry.h"
+#include "scratch_arena.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Static batch: meshes that never move, pre-transformed into world space at load and merged into one vertex
+// and index buffer. Triangles are grouped by material (texture set) and, within a material, by the world grid
+// cell of chunkSize their centroid falls in; each cell's triangles are then clustered into meshlets. Drawing
+// binds the buffers once, then per material binds its textures and multi-draws the meshlets of the chunks
+// inside the frustum that survive meshlet culling. With GPU culling enabled (GL 4.3) a compute shader culls the
+// meshlets instead and writes the draws into an indirect buffer, so the CPU cost no longer grows with them.
+// Depth-only passes draw through a second vertex array that only streams the positions.
+// ---------------------------------------------------------------------------------------------------------
+template<typename Layout = StaticLayout>
+class BasicStaticBatch
+{
+public:
+    // A grid cell's triangles of one material, a contiguous range of the element buffer split into meshlets
+    struct Chunk
+    {
+        MeshBounds bounds;      // World space
+        glm::vec3 center;       // World space bounding sphere
+        float radius;
+        unsigned int firstMeshlet;
+        unsigned int meshletCount;
+    };
+
+    struct Material
+    {
+        std::vector<Texture> textures;
+        std::vector<std::string> samplerNames;
+        bool backfaceCulling;           // Whether its meshlets may be cone culled (see meshlet.h)
+        std::vector<Chunk> chunks;
+        std::vector<Meshlet> meshlets;  // World space, firstIndex counts from the start of the element buffer
+        unsigned int firstCommand;      // Its range of the indirect draw buffer, one slot per meshlet
+    };
+
+    std::vector<Material> materials;
+    MeshBounds bounds;                      // World space bounds, also used to quantize snorm16 positions
+    unsigned int VAO;
+    unsigned int depthVAO;                  // Positions only, same element buffer
+
+    BasicStaticBatch(float chunkSize)
+        : VAO(0), depthVAO(0), chunkSize(chunkSize), VBO(0), EBO(0), positionVBO(0), indexType(GL_UNSIGNED_INT), stagedIndexCount(0), cullShader(nullptr),
+          meshletBuffer(0), commandBuffer(0), counterBuffer(0), totalMeshlets(0)
+    {
+    }
+
+    // Batches own GL objects, so they can't be copied
+    BasicStaticBatch(const BasicStaticBatch&) = delete;
+    BasicStaticBatch& operator=(const BasicStaticBatch&) = delete;
+
+    // Adds every mesh of the model, placed by transform. The model must have been loaded with RESIDENCY_KEEP_ALL;
+    // once everything is added and built its CPU data can be released. Pass backfaceCulling = false for
+    // open or double-sided models (e.g. foliage cards), which are seen from behind.
+    template<typename ModelLayout>
+    void add(const BasicModel<ModelLayout> &model, const glm::mat4 &transform, bool backfaceCulling = true)
+    {
+        for(unsigned int i = 0; i < model.meshes.size(); ++i)
+            addMesh(model.meshes[i], transform, backfaceCulling);
+        for(unsigned int i = 0; i < model.skinnedMeshes.size(); ++i)
+            addMesh(model.skinnedMeshes[i], transform, backfaceCulling);     // Never animated, the bind pose is drawn
+    }
+
+    // Sorts the added triangles into chunks and uploads the buffers
+    void build(const std::string &name)
+    {
+        ScopedResourceOwner owner(ResourceRegistry::owner(name));
+
+        bounds.min = bounds.max = stagedVertices.empty() ? glm::vec3(0.0f) : stagedVertices[0].Position;
+        for(unsigned int i = 1; i < stagedVertices.size(); ++i)
+        {
+            bounds.min = glm::min(bounds.min, stagedVertices[i].Position);
+            bounds.max = glm::max(bounds.max, stagedVertices[i].Position);
+        }
+        Layout::positionDequantization(bounds, positionScale, positionOffset);
+
+        std::vector<unsigned int> indices;
+        indices.reserve(stagedIndexCount);
+        unsigned int maxMeshlets = 0;
+        unsigned int meshletCount = 0;
+        ScratchArena scratch;
+        for(unsigned int m = 0; m < materials.size(); ++m)
+        {
+            buildChunks(materials[m], stagedTriangles[m], indices, scratch);
+            maxMeshlets = std::max(maxMeshlets, static_cast<unsigned int>(materials[m].meshlets.size()));
+            materials[m].firstCommand = meshletCount;
+            meshletCount += static_cast<unsigned int>(materials[m].meshlets.size());
+        }
+        totalMeshlets = meshletCount;
+
+        unsigned int vertexCount = static_cast<unsigned int>(stagedVertices.size());
+        indexType = vertexCount <= MAX_16BIT_INDEXED_VERTICES ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        int ownerId = ResourceRegistry::currentOwner();
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glBindVertexArray(VAO);
+
+        typedef typename Layout::StoredVertex StoredVertex;
+        std::vector<StoredVertex> storage;
+        const StoredVertex* vertexData = Layout::encode(stagedVertices.data(), vertexCount, bounds, storage);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(StoredVertex), vertexData, GL_STATIC_DRAW);
+        ResourceRegistry::record(ownerId, RESOURCE_VERTEX_BUFFER, vertexCount * sizeof(StoredVertex));
+        Layout::Attributes::enable(sizeof(StoredVertex));
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        if(indexType == GL_UNSIGNED_SHORT)
+        {
+            std::vector<unsigned short> shortIndices(indices.begin(), indices.end());
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(unsigned short), shortIndices.data(), GL_STATIC_DRAW);
+        }
+        else
+        {
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        }
+        ResourceRegistry::record(ownerId, RESOURCE_INDEX_BUFFER, indices.size() * indexSize());
+
+        // Position-only stream, decoding to the same positions as the full vertices
+        typedef typename Layout::StoredPosition StoredPosition;
+        std::vector<StoredPosition> positions;
+        extractPositions<Layout>(vertexData, vertexCount, positions);
+        glGenVertexArrays(1, &depthVAO);
+        glGenBuffers(1, &positionVBO);
+        glBindVertexArray(depthVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(StoredPosition), positions.data(), GL_STATIC_DRAW);
+        ResourceRegistry::record(ownerId, RESOURCE_VERTEX_BUFFER, vertexCount * sizeof(StoredPosition));
+        Layout::PositionAttributes::enable(sizeof(StoredPosition));
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+        glBindVertexArray(0);
+
+        // Reserved for the largest material, so Draw never allocates
+        unsigned int maxChunks = 0;
+        for(unsigned int m = 0; m < materials.size(); ++m)
+            maxChunks = std::max(maxChunks, static_cast<unsigned int>(materials[m].chunks.size()));
+        visibleChunks.reserve(maxChunks);
+        drawCounts.reserve(maxMeshlets);
+        drawOffsets.reserve(maxMeshlets);
+
+        std::cout << "STATIC_BATCH::" << name << ":: " << materials.size() << " materials, " << vertexCount << " vertices, "
+                  << indices.size() / 3 << " triangles, " << meshletCount << " meshlets" << std::endl;
+
+        std::vector<Vertex>().swap(stagedVertices);
+        std::vector<std::vector<unsigned int>>().swap(stagedTriangles);
+    }
+
+    // Moves culling to the GPU (needs a GL 4.3 context): uploads the meshlets for the culling compute shader
+    // (shaders/compute/static_batch_cull.cs) and sizes the indirect draw buffer. Call after build.
+    void enableGpuCulling(Shader &cullShader)
+    {
+        ScopedResourceOwner owner(ResourceRegistry::owner("static_batch/gpu_culling"));
+        this->cullShader = &cullShader;
+
+        std::vector<GpuMeshlet> gpuMeshlets;
+        gpuMeshlets.reserve(totalMeshlets);
+        for(unsigned int m = 0; m < materials.size(); ++m)
+        {
+            for(unsigned int i = 0; i < materials[m].meshlets.size(); ++i)
+            {
+                const Meshlet &meshlet = materials[m].meshlets[i];
+                GpuMeshlet gpuMeshlet;
+                gpuMeshlet.sphere = glm::vec4(meshlet.center, meshlet.radius);
+                gpuMeshlet.cone = glm::vec4(meshlet.coneAxis, meshlet.coneCutoff);
+                gpuMeshlet.firstIndex = meshlet.firstIndex;
+                gpuMeshlet.indexCount = meshlet.indexCount;
+                gpuMeshlet.firstCommand = materials[m].firstCommand;
+                gpuMeshlet.flags = m << 1 | (materials[m].backfaceCulling ? 1u : 0u);
+                gpuMeshlets.push_back(gpuMeshlet);
+            }
+        }
+
+        glGenBuffers(1, &meshletBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshletBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, gpuMeshlets.size() * sizeof(GpuMeshlet), gpuMeshlets.data(), GL_STATIC_DRAW);
+
+        glGenBuffers(1, &counterBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, materials.size() * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        glGenBuffers(1, &commandBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, totalMeshlets * sizeof(DrawCommand), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        ResourceRegistry::record(ResourceRegistry::currentOwner(), RESOURCE_STORAGE_BUFFER,
+                                 totalMeshlets * (sizeof(GpuMeshlet) + sizeof(DrawCommand)) + materials.size() * sizeof(GLuint));
+    }
+
+    // Draws what the culling camera can see, one multi-draw per material. Chunks are also skipped when the
+    // occlusion culler, if given, finds them hidden.
+    void Draw(Shader &shader, const MeshletCulling &culling, const OcclusionCuller* occlusion = nullptr)
+    {
+        drawBatch(shader, culling, occlusion, false);
+    }
+
+    // As Draw, but positions only and no textures, for depth pre-passes and occluders. The same culling draws
+    // the same meshlets as Draw, so a later Draw can depth test with GL_EQUAL against it.
+    void DrawDepth(Shader &shader, const MeshletCulling &culling, const OcclusionCuller* occlusion = nullptr)
+    {
+        drawBatch(shader, culling, occlusion, true);
+    }
+
+private:
+    // A meshlet as the culling compute shader reads it (std430)
+    struct GpuMeshlet
+    {
+        glm::vec4 sphere;               // Center and radius
+        glm::vec4 cone;                 // Axis and cutoff
+        unsigned int firstIndex;
+        unsigned int indexCount;
+        unsigned int firstCommand;      // Of its material
+        unsigned int flags;             // Material index << 1 | backface culling
+    };
+
+    // Layout glMultiDrawElementsIndirect reads
+    struct DrawCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    float chunkSize;
+    unsigned int VBO, EBO;
+    unsigned int positionVBO;
+    GLenum indexType;
+
+    // World space vertices and each material's triangles (indices into stagedVertices), until build()
+    std::vector<Vertex> stagedVertices;
+    std::vector<std::vector<unsigned int>> stagedTriangles;
+    unsigned int stagedIndexCount;
+
+    glm::vec3 positionScale;
+    glm::vec3 positionOffset;
+
+    // Visible chunks by squared camera distance, and the ranges of visible meshlets for glMultiDrawElements,
+    // rebuilt for every material
+    struct ChunkDistance
+    {
+        float distance;
+        unsigned int chunk;
+        bool operator<(const ChunkDistance &other) const { return distance < other.distance; }
+    };
+    std::vector<ChunkDistance> visibleChunks;
+    std::vector<GLsizei> drawCounts;
+    std::vector<const void*> drawOffsets;
+
+    // GPU culling, see enableGpuCulling
+    Shader* cullShader;
+    unsigned int meshletBuffer, commandBuffer, counterBuffer;
+    unsigned int totalMeshlets;
+
+    unsigned int indexSize() const
+    {
+        return indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+    }
+
+    // Draw and DrawDepth, through the full or the position-only vertex array
+    void drawBatch(Shader &shader, const MeshletCulling &culling, const OcclusionCuller* occlusion, bool depthOnly)
+    {
+        if(cullShader != nullptr)
+        {
+            drawIndirect(shader, culling, occlusion, depthOnly);
+            return;
+        }
+
+        MeshletFrustum frustum(culling, glm::mat4(1.0f));
+        ObjectConstants::set(glm::mat4(1.0f));
+        shader.setVec3("positionScale", positionScale);
+        shader.setVec3("positionOffset", positionOffset);
+        shader.setBool("octahedralNormals", Layout::OCTAHEDRAL_NORMALS);
+
+        glBindVertexArray(depthOnly ? depthVAO : VAO);
+        for(unsigned int m = 0; m < materials.size(); ++m)
+        {
+            const Material &material = materials[m];
+
+            // Visible chunks, nearest first so early depth testing rejects more of what's behind them
+            visibleChunks.clear();
+            for(unsigned int c = 0; c < material.chunks.size(); ++c)
+            {
+                const Chunk &chunk = material.chunks[c];
+                if(!frustum.visible(chunk.center, chunk.radius))
+                    continue;
+                if(occlusion != nullptr && !occlusion->visible(chunk.bounds, glm::mat4(1.0f)))
+                    continue;
+
+                glm::vec3 toChunk = chunk.center - culling.cameraPosition;
+                ChunkDistance visible = { glm::dot(toChunk, toChunk), c };
+                visibleChunks.push_back(visible);
+            }
+            std::sort(visibleChunks.begin(), visibleChunks.end());
+
+            // Their visible meshlets, merging neighbours in the element buffer into one range
+            bool cullBackfaces = culling.cullBackfaces && material.backfaceCulling;
+            drawCounts.clear();
+            drawOffsets.clear();
+            unsigned int runEnd = 0;
+            for(unsigned int v = 0; v < visibleChunks.size(); ++v)
+            {
+                const Chunk &chunk = material.chunks[visibleChunks[v].chunk];
+                for(unsigned int i = chunk.firstMeshlet; i < chunk.firstMeshlet + chunk.meshletCount; ++i)
+                {
+                    const Meshlet &meshlet = material.meshlets[i];
+                    if(!frustum.visible(meshlet.center, meshlet.radius) || (cullBackfaces && frustum.backfacing(meshlet)))
+                        continue;
+
+                    if(!drawCounts.empty() && meshlet.firstIndex == runEnd)
+                    {
+                        drawCounts.back() += meshlet.indexCount;
+                    }
+                    else
+                    {
+                        drawCounts.push_back(meshlet.indexCount);
+                        drawOffsets.push_back((const void*)(std::size_t)(meshlet.firstIndex * indexSize()));
+                    }
+                    runEnd = meshlet.firstIndex + meshlet.indexCount;
+                }
+            }
+
+            if(drawCounts.empty())
+                continue;
+
+            if(!depthOnly)
+                bindMaterial(shader, material);
+
+            glMultiDrawElements(GL_TRIANGLES, drawCounts.data(), indexType, drawOffsets.data(), static_cast<GLsizei>(drawCounts.size()));
+        }
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void bindMaterial(Shader &shader, const Material &material)
+    {
+        for(unsigned int i = 0; i < material.textures.size(); ++i)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            shader.setInt(material.samplerNames[i].c_str(), i);
+            glBindTexture(GL_TEXTURE_2D, material.textures[i].id);
+        }
+    }
+
+    // Culls every meshlet in the compute shader, which appends the survivors to their material's range of the
+    // cleared indirect buffer, then draws each range (its empty tail draws nothing)
+    void drawIndirect(Shader &shader, const MeshletCulling &culling, const OcclusionCuller* occlusion, bool depthOnly)
+    {
+        const GLuint zero = 0;
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glClearBufferData(GL_DRAW_INDIRECT_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        MeshletFrustum frustum(culling, glm::mat4(1.0f));
+        cullShader->use();
+        cullShader->setUint("meshletCount", totalMeshlets);
+        cullShader->setVec4Array("planes", frustum.planes, 6);
+        cullShader->setVec3("cameraPosition", culling.cameraPosition);
+        cullShader->setBool("cullBackfaces", culling.cullBackfaces);
+        if(occlusion != nullptr)
+            occlusion->bindPyramid(*cullShader, 3);
+        else
+            cullShader->setBool("occlusion", false);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, meshletBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commandBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, counterBuffer);
+        glDispatchCompute((totalMeshlets + 63) / 64, 1, 1);
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+
+        shader.use();
+        ObjectConstants::set(glm::mat4(1.0f));
+        shader.setVec3("positionScale", positionScale);
+        shader.setVec3("positionOffset", positionOffset);
+        shader.setBool("octahedralNormals", Layout::OCTAHEDRAL_NORMALS);
+
+        glBindVertexArray(depthOnly ? depthVAO : VAO);
+        for(unsigned int m = 0; m < materials.size(); ++m)
+        {
+            const Material &material = materials[m];
+            if(material.meshlets.empty())
+                continue;
+
+            if(!depthOnly)
+                bindMaterial(shader, material);
+
+            glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, (const void*)(std::size_t)(material.firstCommand * sizeof(DrawCommand)),
+                                        static_cast<GLsizei>(material.meshlets.size()), 0);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    template<typename MeshLayout>
+    void addMesh(const BasicMesh<MeshLayout> &mesh, const glm::mat4 &transform, bool backfaceCulling)
+    {
+        if(mesh.residency != RESIDENCY_KEEP_ALL)
+        {
+            std::cout << "ERROR::STATIC_BATCH:: Mesh was loaded without RESIDENCY_KEEP_ALL, skipping it" << std::endl;
+            return;
+        }
+
+        // Normals go through the inverse transpose, tangents follow the surface
+        glm::mat3 tangentMatrix(transform);
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(tangentMatrix));
+        unsigned int baseVertex = static_cast<unsigned int>(stagedVertices.size());
+        for(unsigned int i = 0; i < mesh.vertices.size(); ++i)
+        {
+            Vertex vertex = mesh.vertices[i];
+            vertex.Position = glm::vec3(transform * glm::vec4(vertex.Position, 1.0f));
+            vertex.Normal = safeNormalize(normalMatrix * vertex.Normal);
+            vertex.Tangent = safeNormalize(tangentMatrix * vertex.Tangent);
+            vertex.Bitangent = safeNormalize(tangentMatrix * vertex.Bitangent);
+            stagedVertices.push_back(vertex);
+        }
+
+        std::vector<unsigned int> &triangles = stagedTriangles[materialIndex(mesh.textures, backfaceCulling)];
+        for(unsigned int i = 0; i < mesh.indices.size(); ++i)
+            triangles.push_back(baseVertex + mesh.indices[i]);
+        stagedIndexCount += static_cast<unsigned int>(mesh.indices.size());
+    }
+
+    static glm::vec3 safeNormalize(const glm::vec3 &v)
+    {
+        float length = glm::length(v);
+        return length > 0.0f ? v / length : v;
+    }
+
+    // Material with exactly these textures and culling, added if there is none yet
+    unsigned int materialIndex(const std::vector<Texture> &textures, bool backfaceCulling)
+    {
+        for(unsigned int m = 0; m < materials.size(); ++m)
+        {
+            const std::vector<Texture> &other = materials[m].textures;
+            if(other.size() != textures.size() || materials[m].backfaceCulling != backfaceCulling)
+                continue;
+
+            bool same = true;
+            for(unsigned int i = 0; i < textures.size() && same; ++i)
+                same = other[i].id == textures[i].id && other[i].type == textures[i].type;
+            if(same)
+                return m;
+        }
+
+        Material material;
+        material.textures = textures;
+        material.backfaceCulling = backfaceCulling;
+        buildSamplerNames(material.textures, material.samplerNames);
+        materials.push_back(material);
+        stagedTriangles.push_back(std::vector<unsigned int>());
+        return static_cast<unsigned int>(materials.size() - 1);
+    }
+
+    // Orders the material's triangles by grid cell, clusters each cell into meshlets, appends the result to indices
+    // and records one chunk per cell
+    void buildChunks(Material &material, const std::vector<unsigned int> &triangles, std::vector<unsigned int> &indices,
+                     ScratchArena &scratch)
+    {
+        struct CellTriangle
+        {
+            std::uint64_t cell;
+            unsigned int triangle;
+            bool operator<(const CellTriangle &other) const { return cell < other.cell; }
+        };
+
+        unsigned int triangleCount = static_cast<unsigned int>(triangles.size() / 3);
+        std::vector<CellTriangle> order(triangleCount);
+        for(unsigned int t = 0; t < triangleCount; ++t)
+        {
+            glm::vec3 centroid = (stagedVertices[triangles[t * 3 + 0]].Position + stagedVertices[triangles[t * 3 + 1]].Position +
+                                  stagedVertices[triangles[t * 3 + 2]].Position) / 3.0f;
+            glm::vec3 cell = glm::floor((centroid - bounds.min) / chunkSize);
+
+            // 21 bits per axis
+            order[t].cell = (static_cast<std::uint64_t>(cell.x) << 42) | (static_cast<std::uint64_t>(cell.y) << 21) |
+                            static_cast<std::uint64_t>(cell.z);
+            order[t].triangle = t;
+        }
+
+        // Stable, so triangles keep their optimized order within a cell
+        std::stable_sort(order.begin(), order.end());
+
+        for(unsigned int begin = 0; begin < triangleCount; )
+        {
+            unsigned int end = begin;
+            while(end < triangleCount && order[end].cell == order[begin].cell)
+                ++end;
+
+            // The cell's triangles, clustered into meshlets straight into the element buffer
+            unsigned int cellIndexCount = (end - begin) * 3;
+            unsigned int* cellIndices = scratch.allocate<unsigned int>(cellIndexCount);
+            for(unsigned int i = begin; i < end; ++i)
+            {
+                for(unsigned int j = 0; j < 3; ++j)
+                    cellIndices[(i - begin) * 3 + j] = triangles[order[i].triangle * 3 + j];
+            }
+
+            unsigned int firstIndex = static_cast<unsigned int>(indices.size());
+            indices.resize(firstIndex + cellIndexCount);
+            Meshlet* meshlets = scratch.allocate<Meshlet>(cellIndexCount / 3);
+            unsigned int meshletCount = buildMeshlets(meshlets, indices.data() + firstIndex, cellIndices, cellIndexCount,
+                                                      stagedVertices.data(), static_cast<unsigned int>(stagedVertices.size()), scratch);
+
+            Chunk chunk;
+            chunk.firstMeshlet = static_cast<unsigned int>(material.meshlets.size());
+            chunk.meshletCount = meshletCount;
+
+            MeshBounds chunkBounds;
+            chunkBounds.min = chunkBounds.max = stagedVertices[cellIndices[0]].Position;
+            for(unsigned int i = 0; i < cellIndexCount; ++i)
+            {
+                chunkBounds.min = glm::min(chunkBounds.min, stagedVertices[cellIndices[i]].Position);
+                chunkBounds.max = glm::max(chunkBounds.max, stagedVertices[cellIndices[i]].Position);
+            }
+            chunk.bounds = chunkBounds;
+            chunk.center = chunkBounds.center();
+            chunk.radius = glm::length(chunkBounds.extent());
+
+            for(unsigned int i = 0; i < meshletCount; ++i)
+            {
+                meshlets[i].firstIndex += firstIndex;
+                material.meshlets.push_back(meshlets[i]);
+            }
+
+            scratch.reset();
+            material.chunks.push_back(chunk);
+            begin = end;
+        }
+    }
+};
+
+// The batch type the renderer uses
+typedef BasicStaticBatch<StaticLayout> StaticBatch;
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <cmath>
+
+#define MAX_BONE_INFLUENCE 4
+
+// Full precision vertex, used during import and for CPU-side copies
+struct Vertex
+{
+    // Position
+    glm::vec3 Position;
+
+    // Normal
+    glm::vec3 Normal;
+
+    // Texture Coordinates
+    glm::vec2 TexCoords;
+
+    // Tangent
+    glm::vec3 Tangent;
+
+    // Bitangent
+    glm::vec3 Bitangent;
+};
+
+// Skinning data, only stored (in a separate buffer) for meshes that have bones
+struct VertexBoneData
+{
+    // Bone indices which will influence this vertex
+    int m_BoneIDs[MAX_BONE_INFLUENCE];
+    // Weight from each bone
+    float m_Weights[MAX_BONE_INFLUENCE];
+};
+
+// Quantized vertex used by the compact layouts (see vertex_layout.h). The bitangent isn't stored, its sign goes in Position[3]
+// and shaders that need it rebuild it as cross(Normal, Tangent) * sign.
+struct CompactVertex
+{
+    unsigned short Position[4];     // Half floats or snorm16, depending on the layout
+    short Normal[2];                // Octahedral, snorm16
+    short Tangent[2];               // Octahedral, snorm16
+    unsigned short TexCoords[2];    // Half floats
+};
+
+// Axis aligned bounds of a mesh in model space
+struct MeshBounds
+{
+    glm::vec3 min;
+    glm::vec3 max;
+
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    glm::vec3 extent() const { return (max - min) * 0.5f; }
+};
+
+// Octahedral normal encoding: folds the unit sphere onto the [-1, 1] square
+// (decoded by octDecode in the vertex shaders)
+inline glm::vec2 octEncode(glm::vec3 n)
+{
+    float sum = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if(sum == 0.0f)
+        return glm::vec2(0.0f, 0.0f);
+
+    n /= sum;
+    glm::vec2 e(n.x, n.y);
+    if(n.z < 0.0f)
+    {
+        e = glm::vec2((1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                      (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+    }
+    return e;
+}
+
+inline short packSnorm16(float value)
+{
+    return static_cast<short>(glm::packSnorm1x16(value));
+}
+
+inline unsigned short packHalf(float value)
+{
+    return glm::packHalf1x16(value);
+}
+
+// Sign of the tangent frame's handedness, so the bitangent can be rebuilt from normal and tangent
+inline float bitangentSign(const Vertex &vertex)
+{
+    return glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+}
+
+// Packs everything but the position of a compact vertex
+inline void packCompactAttributes(const Vertex &vertex, CompactVertex &result)
+{
+    glm::vec2 normal = octEncode(vertex.Normal);
+    glm::vec2 tangent = octEncode(vertex.Tangent);
+    result.Normal[0] = packSnorm16(normal.x);
+    result.Normal[1] = packSnorm16(normal.y);
+    result.Tangent[0] = packSnorm16(tangent.x);
+    result.Tangent[1] = packSnorm16(tangent.y);
+    result.TexCoords[0] = packHalf(vertex.TexCoords.x);
+    result.TexCoords[1] = packHalf(vertex.TexCoords.y);
+}
+
+#endif
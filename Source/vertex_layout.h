@@ -0,0 +1,130 @@
+#ifndef VERTEX_LAYOUT_H
+#define VERTEX_LAYOUT_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "vertex_format.h"
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+// Vertex layout descriptors. Each layout names the struct stored in the vertex buffer, how to encode it from
+// an imported Vertex and the attribute pointers to set for it. Mesh is a template over the layout, so the
+// attribute setup is generated at compile time and a mesh only binds the attributes its layout lists.
+// -----------------------------------------------------------------------------------------------------------
+
+// A float (or normalized integer) attribute at a fixed offset of the stored vertex
+template<GLuint Location, GLint Size, GLenum Type, GLboolean Normalized, std::size_t Offset>
+struct FloatAttribute
+{
+    static void enable(GLsizei stride)
+    {
+        glEnableVertexAttribArray(Location);
+        glVertexAttribPointer(Location, Size, Type, Normalized, stride, (void*)Offset);
+    }
+};
+
+// An integer attribute, read as ivec / uvec in the shader
+template<GLuint Location, GLint Size, GLenum Type, std::size_t Offset>
+struct IntegerAttribute
+{
+    static void enable(GLsizei stride)
+    {
+        glEnableVertexAttribArray(Location);
+        glVertexAttribIPointer(Location, Size, Type, stride, (void*)Offset);
+    }
+};
+
+template<typename... Attributes>
+struct AttributeList
+{
+    static void enable(GLsizei stride)
+    {
+        // One enable() per attribute, in order
+        int expand[] = { 0, (Attributes::enable(stride), 0)... };
+        (void)expand;
+        (void)stride;
+    }
+};
+
+// A compact layout's stored position on its own (see PositionAttributes below)
+struct PackedPosition
+{
+    unsigned short value[4];
+};
+
+// Copies the leading position of every stored vertex into a position-only stream, for depth-only passes that
+// fetch nothing else. Every StoredVertex keeps its position first, in the layout's StoredPosition format, so the
+// stream decodes to exactly the positions of the full vertices.
+template<typename Layout>
+void extractPositions(const typename Layout::StoredVertex* vertices, unsigned int count,
+                      std::vector<typename Layout::StoredPosition> &positions)
+{
+    positions.resize(count);
+    for(unsigned int i = 0; i < count; ++i)
+        std::memcpy(&positions[i], &vertices[i], sizeof(typename Layout::StoredPosition));
+}
+
+// Snorm16 positions scaled by the mesh bounds, octahedral normal / tangent, half-float UVs (20 bytes)
+// ---------------------------------------------------------------------------------------------------
+struct Snorm16Layout
+{
+    typedef CompactVertex StoredVertex;
+    typedef AttributeList<
+        FloatAttribute<0, 4, GL_SHORT, GL_TRUE, offsetof(CompactVertex, Position)>,
+        FloatAttribute<1, 2, GL_SHORT, GL_TRUE, offsetof(CompactVertex, Normal)>,
+        FloatAttribute<2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(CompactVertex, TexCoords)>,
+        FloatAttribute<3, 2, GL_SHORT, GL_TRUE, offsetof(CompactVertex, Tangent)>> Attributes;
+    typedef AttributeList<> BoneAttributes;
+    typedef PackedPosition StoredPosition;
+    typedef AttributeList<FloatAttribute<0, 4, GL_SHORT, GL_TRUE, 0>> PositionAttributes;
+
+    static const bool TEXTURED = true;
+    static const bool SKINNED = false;
+    static const bool OCTAHEDRAL_NORMALS = true;
+
+    static void positionDequantization(const MeshBounds &bounds, glm::vec3 &scale, glm::vec3 &offset)
+    {
+        // Avoid a zero scale for flat meshes
+        scale = glm::max(bounds.extent(), glm::vec3(1e-6f));
+        offset = bounds.center();
+    }
+
+    static const StoredVertex* encode(const Vertex* vertices, unsigned int count, const MeshBounds &bounds,
+                                      std::vector<StoredVertex> &storage)
+    {
+        glm::vec3 scale, offset;
+        positionDequantization(bounds, scale, offset);
+
+        storage.resize(count);
+        for(unsigned int i = 0; i < count; ++i)
+        {
+            glm::vec3 position = (vertices[i].Position - offset) / scale;
+            for(int j = 0; j < 3; ++j)
+                storage[i].Position[j] = static_cast<unsigned short>(packSnorm16(position[j]));
+            storage[i].Position[3] = static_cast<unsigned short>(packSnorm16(bitangentSign(vertices[i])));
+            packCompactAttributes(vertices[i], storage[i]);
+        }
+        return storage.data();
+    }
+};
+
+// A layout plus a bone id / weight stream in a second buffer
+// ----------------------------------------------------------
+template<typename Base>
+struct SkinnedLayout : Base
+{
+    typedef AttributeList<
+        IntegerAttribute<5, 4, GL_INT, offsetof(VertexBoneData, m_BoneIDs)>,
+        FloatAttribute<6, 4, GL_FLOAT, GL_FALSE, offsetof(VertexBoneData, m_Weights)>> BoneAttributes;
+
+    static const bool SKINNED = true;
+};
+
+// Layout the models use unless told otherwise
+typedef Snorm16Layout StaticLayout;
+
+#endif